@@ -29,6 +29,10 @@
 #include "originator.h"
 #include "schedule.h"
 #include "trans_table.h"
+#include "probe.h"
+#include "metric.h"
+#include "snapshot.h"
+#include "config.h"
 
 
 
@@ -93,11 +97,51 @@ uint8_t routing_class = 0;
 
 
 int16_t originator_interval = 1000;   /* originator message interval in miliseconds */
+int16_t originator_interval_max = 0;  /* "-A" grow the interval up to this value while the topology is stable (0 = off) */
+int16_t originator_interval_curr = 1000;
+
+uint16_t local_win_size = TQ_LOCAL_WINDOW_SIZE;   /* "-w" sliding window size in sequence numbers */
+uint8_t local_win_words = ( TQ_LOCAL_WINDOW_SIZE + WORD_BIT_SIZE - 1 ) / WORD_BIT_SIZE;
+
+uint8_t global_win_size = TQ_GLOBAL_WINDOW_SIZE;   /* "-W" number of tq values averaged per neighbour */
+uint8_t tq_ewma_shift = 0;                         /* "-E" average tq values with a weight of 1/2^n instead (0 = off) */
+
+/* protocol parameters which can be changed at runtime as well (see config.c) */
+uint16_t jitter = JITTER;
+uint8_t ttl = TTL;
+int32_t purge_timeout = PURGE_TIMEOUT;
+uint8_t hop_penalty = TQ_HOP_PENALTY;
+uint16_t packets_per_cycle = PACKETS_PER_CYCLE;
+uint32_t age_threshold = AGE_THRESHOLD;
+uint8_t bcast_unknown_dest = BROADCAST_UNKNOWN_DEST;
+
+uint8_t aggregation_enabled = 0;   /* "-a" send the OGMs due within MAX_AGGREGATION_MS in one frame */
+
+uint8_t fisheye_radius = 0;   /* "-f" OGMs are forwarded at the full rate within this many hops only (0 = off) */
+
+uint8_t route_hyst_tq = 0;       /* "-y" another neighbour has to be better than the router by more than this to replace it */
+uint16_t route_hold_time = 0;    /* "-Y" and the router has to be in place for at least this many ms */
+uint32_t route_changes_kept = 0; /* how often the router was kept although another neighbour was better */
+
+uint8_t if_alt_margin = 0;        /* "-I" relay via a router on another interface if its tq is lower by less than this (0 = off) */
+uint32_t if_alt_packets = 0;      /* packets relayed via another interface than the router's */
+
+uint8_t bonding_mode = BONDING_OFF;  /* "-B" spread the unicast packets over several routers per originator */
+uint8_t bonding_tolerance = 0;       /* "-T" routers which are worse than the best one by at most this tq are used for bonding */
+
+uint8_t metric_engine = METRIC_TQ;         /* "-m" what the routers are chosen by - all nodes have to use the same */
+uint16_t probe_interval = PROBE_INTERVAL;  /* "-P" link probe bursts are sent this often in ms (throughput metric only, 0 = off) */
 
 struct gw_node *curr_gateway = NULL;
 pthread_t curr_gateway_thread_id = 0;
 
-uint32_t pref_gateway = 0;
+uint8_t *pref_gateway = NULL;   /* "-p" mac address of the gateway which is used whenever it is available */
+
+uint8_t dhcp_steering = 0;        /* "-D" send the DHCP requests of our clients to the selected gateway only */
+uint32_t dhcp_steered = 0;        /* DHCP requests sent to the gateway instead of being flooded */
+uint32_t dhcp_offers_dropped = 0; /* DHCP offers of the other gateways kept away from our clients */
+
+char *snapshot_file = NULL;       /* "-S" the routing state is saved to this file and picked up again at the next start */
 
 uint8_t found_ifs = 0;
 int32_t receive_max_sock = 0;
@@ -113,10 +157,22 @@ uint8_t unix_client = 0;
 struct unix_client *unix_packet[256];
 
 
-struct hashtable_t *orig_hash;
+struct hashtable_t *orig_hash[ORIG_HASH_SHARDS];   /* each shard grows on its own - a resize only copies a fraction of the originators */
+struct orig_node **orig_index = NULL;   /* all originators without gaps - for the passes over all of them */
+uint32_t orig_num = 0;
+uint32_t orig_index_size = 0;
+struct hashtable_t *forw_hash;   /* forwarded packets not sent yet - to coalesce them */
+struct hashtable_t *link_hash;   /* one hop neighbours per interface - shared by the routes via them */
 
 struct list_head_first forw_list;
-struct list_head_first gw_list;
+uint16_t forw_list_len = 0;
+uint32_t forw_coalesced = 0;
+struct pool forw_pool;           /* the forw_nodes including their packet buffer */
+struct pool orig_pool;           /* the originators, neighbours and links including their windows */
+struct pool neigh_pool;
+struct pool link_pool;
+uint32_t forw_dropped = 0;
+struct dlist_head gw_list = DLIST_HEAD_INIT(gw_list);     /* sorted by the gateway score (see gw_node_update()) */
 struct list_head_first if_list;
 
 struct vis_if vis_if;
@@ -131,17 +187,33 @@ uint16_t vis_packet_size = 0;
 void usage( void ) {
 
 	fprintf( stderr, "Usage: batman [options] interface [interface interface]\n" );
+	fprintf( stderr, "       -a aggregate originator messages\n" );
+	fprintf( stderr, "       -A maximal adaptive originator interval in ms\n" );
 	fprintf( stderr, "       -b run connection in batch mode\n" );
+	fprintf( stderr, "       -B bonding mode\n" );
 	fprintf( stderr, "       -c connect via unix socket\n" );
 	fprintf( stderr, "       -d debug level\n" );
-/*	fprintf( stderr, "       -g gateway class\n" );*/
+	fprintf( stderr, "       -D DHCP steering\n" );
+	fprintf( stderr, "       -f fisheye radius\n" );
+	fprintf( stderr, "       -g gateway class\n" );
 	fprintf( stderr, "       -h this help\n" );
 	fprintf( stderr, "       -H verbose help\n" );
+	fprintf( stderr, "       -I interface alternation margin in tq\n" );
+	fprintf( stderr, "       -m routing metric\n" );
 	fprintf( stderr, "       -o originator interval in ms\n" );
-/*	fprintf( stderr, "       -p preferred gateway\n" );
-	fprintf( stderr, "       -r routing class\n" );*/
+	fprintf( stderr, "       -O protocol parameter as name=value\n" );
+	fprintf( stderr, "       -p preferred gateway\n" );
+	fprintf( stderr, "       -P link probe interval in ms\n" );
+	fprintf( stderr, "       -r routing class\n" );
 	fprintf( stderr, "       -s visualisation server\n" );
+	fprintf( stderr, "       -S state snapshot file\n" );
+	fprintf( stderr, "       -T bonding tolerance in tq\n" );
 	fprintf( stderr, "       -v print version\n" );
+	fprintf( stderr, "       -w sequence number window size\n" );
+	fprintf( stderr, "       -W tq average window size\n" );
+	fprintf( stderr, "       -E tq moving average weight\n" );
+	fprintf( stderr, "       -y route hysteresis in tq\n" );
+	fprintf( stderr, "       -Y route hold time in ms\n" );
 
 }
 
@@ -150,7 +222,16 @@ void usage( void ) {
 void verbose_usage( void ) {
 
 	fprintf( stderr, "Usage: batman [options] interface [interface interface]\n\n" );
+	fprintf( stderr, "       -a aggregate originator messages (all nodes have to understand aggregated frames)\n" );
+	fprintf( stderr, "          default: off\n\n" );
+	fprintf( stderr, "       -A maximal adaptive originator interval in ms (the interval grows from -o up to this\n" );
+	fprintf( stderr, "          value while the topology is stable and drops back to -o on changes)\n" );
+	fprintf( stderr, "          default: 0 -> off, allowed values: -o - %i\n\n", ORIG_INTERVAL_LIMIT );
 	fprintf( stderr, "       -b run connection in batch mode\n" );
+	fprintf( stderr, "       -B bonding mode (unicast packets are spread over all routers within -T of the best one)\n" );
+	fprintf( stderr, "          default:         0 -> off\n" );
+	fprintf( stderr, "          allowed values:  1 -> round robin\n" );
+	fprintf( stderr, "                           2 -> per flow (keeps the packets of a flow in order)\n\n" );
 	fprintf( stderr, "       -c connect to running batmand via unix socket\n" );
 	fprintf( stderr, "       -d debug level\n" );
 	fprintf( stderr, "          default:         0 -> debug disabled\n" );
@@ -158,7 +239,12 @@ void verbose_usage( void ) {
 	fprintf( stderr, "                           2 -> list gateways\n" );
 	fprintf( stderr, "                           3 -> observe batman\n" );
 	fprintf( stderr, "                           4 -> observe batman (very verbose)\n\n" );
-/*	fprintf( stderr, "       -g gateway class\n" );
+	fprintf( stderr, "       -D DHCP steering (DHCP requests go to the selected gateway only, the offers of the\n" );
+	fprintf( stderr, "          other gateways are dropped - needs -r)\n" );
+	fprintf( stderr, "          default: off\n\n" );
+	fprintf( stderr, "       -f fisheye radius (OGMs which travelled farther are forwarded with fewer seqnos)\n" );
+	fprintf( stderr, "          default: 0 -> off, allowed values: 1 - %i\n\n", ttl );
+	fprintf( stderr, "       -g gateway class\n" );
 	fprintf( stderr, "          default:         0 -> this is not an internet gateway\n" );
 	fprintf( stderr, "          allowed values:  1 -> modem line\n" );
 	fprintf( stderr, "                           2 -> ISDN line\n" );
@@ -170,134 +256,196 @@ void verbose_usage( void ) {
 	fprintf( stderr, "                           8 -> 3 MBit\n" );
 	fprintf( stderr, "                           9 -> 5 MBit\n" );
 	fprintf( stderr, "                          10 -> 6 MBit\n" );
-	fprintf( stderr, "                          11 -> >6 MBit\n\n" );*/
+	fprintf( stderr, "                          11 -> >6 MBit\n\n" );
 	fprintf( stderr, "       -h shorter help\n" );
 	fprintf( stderr, "       -H this help\n" );
+	fprintf( stderr, "       -I interface alternation margin (relayed packets leave via another interface if the\n" );
+	fprintf( stderr, "          best router there is worse by less than this tq)\n" );
+	fprintf( stderr, "          default: 0 -> off, allowed values: 0 - %i\n\n", TQ_MAX_VALUE );
+	fprintf( stderr, "       -m routing metric (all nodes have to use the same)\n" );
+	fprintf( stderr, "          default:         0 -> transmit quality\n" );
+	fprintf( stderr, "          allowed values:  1 -> bottleneck throughput of the path (measured by link probes)\n\n" );
 	fprintf( stderr, "       -o originator interval in ms\n" );
 	fprintf( stderr, "          default: 1000, allowed values: >0\n\n" );
-/*	fprintf( stderr, "       -p preferred gateway\n" );
-	fprintf( stderr, "          default: none, allowed values: IP\n\n" );
+	fprintf( stderr, "       -O protocol parameter as name=value (can be given several times, in client mode the\n" );
+	fprintf( stderr, "          parameter of the running batmand is changed - \"-c\" alone lists all of them)\n" );
+	fprintf( stderr, "          jitter                  own OGMs are sent up to this many ms earlier or later (default: %i)\n", JITTER );
+	fprintf( stderr, "          ttl                     ttl of the OGMs and unicast packets, the same on all nodes with -f (default: %i)\n", TTL );
+	fprintf( stderr, "          purge_timeout           originators are purged after this many ms without OGM (default: %i)\n", PURGE_TIMEOUT );
+	fprintf( stderr, "          hop_penalty             tq reduction per hop (default: %i)\n", TQ_HOP_PENALTY );
+	fprintf( stderr, "          local_window            same as -w (default: %i)\n", TQ_LOCAL_WINDOW_SIZE );
+	fprintf( stderr, "          global_window           same as -W (default: %i)\n", TQ_GLOBAL_WINDOW_SIZE );
+	fprintf( stderr, "          packets_per_cycle       packets read from the tap interface at once (default: %i)\n", PACKETS_PER_CYCLE );
+	fprintf( stderr, "          age_threshold           clients of other nodes are forgotten after this many ms (default: %i)\n", AGE_THRESHOLD );
+	fprintf( stderr, "          broadcast_unknown_dest  flood packets to unknown destinations (default: %i)\n\n", BROADCAST_UNKNOWN_DEST );
+	fprintf( stderr, "       -p preferred gateway (used whenever it is reachable)\n" );
+	fprintf( stderr, "          default: none, allowed values: mac address\n\n" );
+	fprintf( stderr, "       -P link probe interval in ms (every neighbour gets %i probes of up to %i bytes, throughput metric only)\n", PROBE_PACKETS, PROBE_SIZE );
+	fprintf( stderr, "          default: %i, allowed values: 0 -> off, 1 - %i\n\n", PROBE_INTERVAL, PROBE_INTERVAL_MAX );
 	fprintf( stderr, "       -r routing class (only needed if gateway class = 0)\n" );
 	fprintf( stderr, "          default:         0 -> set no default route\n" );
-	fprintf( stderr, "          allowed values:  1 -> use fast internet connection\n" );
-	fprintf( stderr, "                           2 -> use stable internet connection\n" );
-	fprintf( stderr, "                           3 -> use best statistic internet connection (olsr style)\n\n" );*/
+	fprintf( stderr, "          allowed values:  1 -> use fast internet connection (gateway bandwidth weighted by the path)\n" );
+	fprintf( stderr, "                           2 -> use stable internet connection (best path, bandwidth decides ties)\n" );
+	fprintf( stderr, "                           3 -> use best statistic internet connection (olsr style)\n\n" );
 	fprintf( stderr, "       -s visualisation server\n" );
 	fprintf( stderr, "          default: none, allowed values: IP\n\n" );
+	fprintf( stderr, "       -S state snapshot file (the routing state is saved every %i s and at shutdown and\n", SNAPSHOT_INTERVAL / 1000 );
+	fprintf( stderr, "          picked up again at startup if it is younger than %i s)\n", SNAPSHOT_MAX_AGE );
+	fprintf( stderr, "          default: none\n\n" );
+	fprintf( stderr, "       -T bonding tolerance (routers worse than the best one by at most this tq are used, see -B)\n" );
+	fprintf( stderr, "          default: 0, allowed values: 0 - %i\n\n", TQ_MAX_VALUE );
 	fprintf( stderr, "       -v print version\n" );
+	fprintf( stderr, "       -w sequence number window size (the link quality is measured over this many OGMs)\n" );
+	fprintf( stderr, "          default: %i, allowed values: %i - %i\n\n", TQ_LOCAL_WINDOW_SIZE, TQ_LOCAL_WINDOW_MIN, TQ_LOCAL_WINDOW_MAX );
+	fprintf( stderr, "       -W tq average window size (number of tq values averaged per neighbour)\n" );
+	fprintf( stderr, "          default: %i, allowed values: 1 - %i\n\n", TQ_GLOBAL_WINDOW_SIZE, TQ_GLOBAL_WINDOW_MAX );
+	fprintf( stderr, "       -E tq moving average weight (new tq values are weighted with 1/2^n, replaces -W)\n" );
+	fprintf( stderr, "          default: 0 -> off, allowed values: 0 - %i\n\n", TQ_EWMA_SHIFT_MAX );
+	fprintf( stderr, "       -y route hysteresis (another neighbour must be better than the router by more than this tq)\n" );
+	fprintf( stderr, "          default: 0 -> off, allowed values: 0 - %i\n\n", TQ_MAX_VALUE );
+	fprintf( stderr, "       -Y route hold time in ms (a new router is kept at least this long unless it fails)\n" );
+	fprintf( stderr, "          default: 0 -> off, allowed values: 0 - %i\n\n", ROUTE_HOLD_TIME_MAX );
 
 }
 
 
 
-// static void choose_gw() {
-//
-// 	struct list_head *pos;
-// 	struct gw_node *gw_node, *tmp_curr_gw = NULL;
-// 	uint8_t max_gw_class = 0, max_packets = 0, max_gw_factor = 0;
-// 	static char orig_str[ADDR_STR_LEN];
-//
-//
-// 	if ( routing_class == 0 )
-// 		return;
-//
-// 	if ( list_empty(&gw_list) ) {
-//
-// 		if ( curr_gateway != NULL ) {
-//
-// 			debug_output( 3, "Removing default route - no gateway in range\n" );
-//
-// 			del_default_route();
-//
-// 		}
-//
-// 		return;
-//
-// 	}
-//
-//
-// 	list_for_each(pos, &gw_list) {
-//
-// 		gw_node = list_entry(pos, struct gw_node, list);
-//
-// 		/* ignore this gateway if recent connection attempts were unsuccessful */
-// 		if ( ( gw_node->unavail_factor * gw_node->unavail_factor * 30000 ) + gw_node->last_failure > get_time() )
-// 			continue;
-//
-// 		if ( gw_node->orig_node->router == NULL )
-// 			continue;
-//
-// 		if ( gw_node->deleted )
-// 			continue;
-//
-// 		switch ( routing_class ) {
-//
-// 			case 1:   /* fast connection */
-// 				if ( ( ( gw_node->orig_node->router->packet_count * gw_node->orig_node->gwflags ) > max_gw_factor ) || ( ( ( gw_node->orig_node->router->packet_count * gw_node->orig_node->gwflags ) == max_gw_factor ) && ( gw_node->orig_node->router->packet_count > max_packets ) ) )
-// 					tmp_curr_gw = gw_node;
-// 				break;
-//
-// 			case 2:   /* stable connection */
-// 				/* FIXME - not implemented yet */
-// 				if ( ( ( gw_node->orig_node->router->packet_count * gw_node->orig_node->gwflags ) > max_gw_factor ) || ( ( ( gw_node->orig_node->router->packet_count * gw_node->orig_node->gwflags ) == max_gw_factor ) && ( gw_node->orig_node->router->packet_count > max_packets ) ) )
-// 					tmp_curr_gw = gw_node;
-// 				break;
-//
-// 			default:  /* use best statistic (olsr style) */
-// 				if ( gw_node->orig_node->router->packet_count > max_packets )
-// 					tmp_curr_gw = gw_node;
-// 				break;
-//
-// 		}
-//
-// 		if ( gw_node->orig_node->gwflags > max_gw_class )
-// 			max_gw_class = gw_node->orig_node->gwflags;
-//
-// 		if ( gw_node->orig_node->router->packet_count > max_packets )
-// 			max_packets = gw_node->orig_node->router->packet_count;
-//
-// 		if ( ( gw_node->orig_node->router->packet_count * gw_node->orig_node->gwflags ) > max_gw_class )
-// 			max_gw_factor = ( gw_node->orig_node->router->packet_count * gw_node->orig_node->gwflags );
-//
-// 		if ( ( pref_gateway != 0 ) && ( pref_gateway == gw_node->orig_node->orig ) ) {
-//
-// 			tmp_curr_gw = gw_node;
-//
-// 			debug_output( 3, "Preferred gateway found: %s (%i,%i,%i)\n", addr_to_string( tmp_curr_gw->orig_node->orig ), gw_node->orig_node->gwflags, gw_node->orig_node->router->packet_count, ( gw_node->orig_node->router->packet_count * gw_node->orig_node->gwflags ) );
-//
-// 			break;
-//
-// 		}
-//
-// 	}
-//
-//
-// 	if ( curr_gateway != tmp_curr_gw ) {
-//
-// 		if ( curr_gateway != NULL ) {
-//
-// 			debug_output( 3, "Removing default route - better gateway found\n" );
-//
-// 			del_default_route();
-//
-// 		}
-//
-// 		curr_gateway = tmp_curr_gw;
-//
-// 		/* may be the last gateway is now gone */
-// 		if ( ( curr_gateway != NULL ) && ( !is_aborted() ) ) {
-//
-// 			addr_to_string( curr_gateway->orig_node->orig, orig_str, ADDR_STR_LEN );
-// 			debug_output( 3, "Adding default route to %s (%i,%i,%i)\n", orig_str, max_gw_class, max_packets, max_gw_factor );
-//
-// 			add_default_route();
-//
-// 		}
-//
-// 	}
-//
-// }
-//
+/* kbit/s per gateway class (see gw2string) */
+static uint16_t gw_bandwidth[GW_CLASS_MAX + 1] = { 0, 56, 64, 128, 256, 512, 1024, 2048, 3072, 5120, 6144, 8192 };
+
+
+
+static uint32_t gw_score( struct gw_node *gw_node ) {
+
+	struct orig_node *orig_node = gw_node->orig_node;
+	uint32_t tq, path_bandwidth;
+
+	if ( ( gw_node->deleted ) || ( orig_node == NULL ) || ( orig_node->router == NULL ) || ( orig_node->router->tq_avg == 0 ) )
+		return 0;
+
+	if ( ( orig_node->gwflags == 0 ) || ( orig_node->gwflags > GW_CLASS_MAX ) )
+		return 0;
+
+	if ( ( pref_gateway != NULL ) && ( compare_orig( pref_gateway, orig_node->orig ) == 0 ) )
+		return UINT32_MAX;
+
+	tq = orig_node->router->tq_avg;
+
+	switch ( routing_class ) {
+
+		case 1:   /* fast connection: the bandwidth of the gateway weighted by the path */
+			if ( metric_engine != METRIC_THROUGHPUT )
+				return tq * gw_bandwidth[orig_node->gwflags];
+
+			/* the path throughput is known - the slower of both limits the uplink */
+			path_bandwidth = probe_decode( tq );
+			return ( path_bandwidth < gw_bandwidth[orig_node->gwflags] ? path_bandwidth : gw_bandwidth[orig_node->gwflags] );
+
+		case 2:   /* stable connection: the best path, the bandwidth only decides between equal paths */
+			return tq * ( GW_CLASS_MAX + 1 ) + orig_node->gwflags;
+
+		default:  /* use best statistic (olsr style) */
+			return tq;
+
+	}
+
+}
+
+
+
+/* the score of the gateway changed - move it to its new position within the (otherwise sorted) gw_list */
+static void gw_rank_update( struct gw_node *gw_node ) {
+
+	struct dlist_head *pos;
+
+	for ( pos = gw_node->list.prev; pos != &gw_list; pos = pos->prev ) {
+
+		if ( gw_node->score <= dlist_entry( pos, struct gw_node, list )->score )
+			break;
+
+	}
+
+	if ( pos != gw_node->list.prev ) {
+
+		dlist_del( &gw_node->list );
+		dlist_add( &gw_node->list, pos );
+		return;
+
+	}
+
+	for ( pos = gw_node->list.next; pos != &gw_list; pos = pos->next ) {
+
+		if ( dlist_entry( pos, struct gw_node, list )->score <= gw_node->score )
+			break;
+
+	}
+
+	if ( pos != gw_node->list.next ) {
+
+		dlist_del( &gw_node->list );
+		dlist_add_tail( &gw_node->list, pos );
+
+	}
+
+}
+
+
+
+/* the best gateway is at the head of gw_list - switch to it if the current one is gone or clearly worse */
+static void choose_gw( void ) {
+
+	struct gw_node *best_gw_node = NULL;
+
+	if ( routing_class == 0 )
+		return;
+
+	if ( ( !dlist_empty( &gw_list ) ) && ( dlist_entry( gw_list.next, struct gw_node, list )->score > 0 ) )
+		best_gw_node = dlist_entry( gw_list.next, struct gw_node, list );
+
+	if ( curr_gateway == best_gw_node )
+		return;
+
+	if ( ( curr_gateway != NULL ) && ( curr_gateway->score > 0 ) && ( best_gw_node != NULL ) &&
+	     ( (uint64_t)best_gw_node->score * 100 <= (uint64_t)curr_gateway->score * ( 100 + GW_SWITCH_THRESHOLD ) ) )
+		return;
+
+	if ( curr_gateway != NULL ) {
+
+		debug_output( 3, "Removing default route - %s\n", ( best_gw_node != NULL ? "better gateway found" : "no gateway in range" ) );
+
+		del_default_route();
+
+	}
+
+	curr_gateway = best_gw_node;
+
+	/* may be the last gateway is now gone */
+	if ( ( curr_gateway != NULL ) && ( !is_aborted() ) ) {
+
+		debug_output( 3, "Adding default route to %s (class %i - %s, score %u)\n", addr_to_string_static( curr_gateway->orig_node->orig ), curr_gateway->orig_node->gwflags, gw2string[curr_gateway->orig_node->gwflags], curr_gateway->score );
+
+		add_default_route();
+
+	}
+
+}
+
+
+
+/* called whenever the router, the tq or the class of a gateway changed - only this gateway is looked at */
+void gw_node_update( struct gw_node *gw_node ) {
+
+	uint32_t score = gw_score( gw_node );
+
+	if ( score == gw_node->score )
+		return;
+
+	gw_node->score = score;
+	gw_rank_update( gw_node );
+
+	choose_gw();
+
+}
 
 
 
@@ -310,12 +458,18 @@ void update_routes( struct orig_node *orig_node, struct neigh_node *neigh_node,
 
 	if ( ( orig_node != NULL ) && ( orig_node->router != neigh_node ) ) {
 
+		orig_interval_reset();
+
+		if ( ( orig_node->router != NULL ) && ( neigh_node != NULL ) )
+			orig_node->route_flaps++;
+
+		orig_node->route_changed = curr_time;
 
 
 		if ((orig_node != NULL) && (neigh_node != NULL)) {
 
 			addr_to_string(str1, orig_node->orig);
-			addr_to_string(str2, neigh_node->addr);
+			addr_to_string(str2, neigh_node->link->addr);
 			debug_output( 4, "Route to %s via %s\n", str1, str2);
 
 		}
@@ -344,7 +498,7 @@ void update_routes( struct orig_node *orig_node, struct neigh_node *neigh_node,
 
 //			add_del_route( orig_node->orig, 32, neigh_node->addr, 0, neigh_node->if_incoming->dev, neigh_node->if_incoming->udp_send_sock );
 
-			orig_node->batman_if = neigh_node->if_incoming;
+			orig_node->batman_if = neigh_node->link->if_incoming;
 			orig_node->router = neigh_node;
 
 		}
@@ -352,6 +506,10 @@ void update_routes( struct orig_node *orig_node, struct neigh_node *neigh_node,
 
 	}
 
+	/* the gateway ranking depends on the router and its tq */
+	if ( orig_node->gw_node != NULL )
+		gw_node_update( orig_node->gw_node );
+
 
 	if ((hna_recv_buff == NULL) && (orig_node->hna_buff == NULL)) {
 		/* great, nothing to do. */
@@ -388,50 +546,46 @@ void update_routes( struct orig_node *orig_node, struct neigh_node *neigh_node,
 
 void update_gw_list( struct orig_node *orig_node, uint8_t new_gwflags ) {
 
-	struct list_head *gw_pos, *gw_pos_tmp;
-	struct gw_node *gw_node = NULL;
+	struct gw_node *gw_node = orig_node->gw_node;
 
-	list_for_each_safe( gw_pos, gw_pos_tmp, &gw_list ) {
+	if ( gw_node != NULL ) {
 
-		gw_node = list_entry(gw_pos, struct gw_node, list);
+		debug_output(3, "Gateway class of originator %s changed from %i to %i \n", addr_to_string_static(orig_node->orig), orig_node->gwflags, new_gwflags);
 
-		if ( gw_node->orig_node == orig_node ) {
+		if ( new_gwflags == 0 ) {
 
-			debug_output(3, "Gateway class of originator %s changed from %i to %i \n", addr_to_string_static(gw_node->orig_node->orig), gw_node->orig_node->gwflags, new_gwflags);
+			gw_node->deleted = get_time();
 
-			if ( new_gwflags == 0 ) {
+			debug_output(3, "Gateway %s removed from gateway list \n", addr_to_string_static(orig_node->orig));
 
-				gw_node->deleted = get_time();
+		} else {
 
-				debug_output(3, "Gateway %s removed from gateway list \n", addr_to_string_static(gw_node->orig_node->orig));
+			gw_node->deleted = 0;
 
-			} else {
-
-				gw_node->deleted = 0;
-				gw_node->orig_node->gwflags = new_gwflags;
+		}
 
-			}
+	} else {
 
-// 			choose_gw();
+		if ( new_gwflags == 0 )
 			return;
 
-		}
-
-	}
+		debug_output(3, "Found new gateway %s -> class: %i - %s \n", addr_to_string_static(orig_node->orig), new_gwflags, ( new_gwflags > GW_CLASS_MAX ? "unknown" : gw2string[new_gwflags] ));
 
-	debug_output(3, "Found new gateway %s -> class: %i - %s \n", addr_to_string_static(orig_node->orig), new_gwflags, gw2string[new_gwflags]);
+		gw_node = debugMalloc( sizeof(struct gw_node), 103 );
+		memset( gw_node, 0, sizeof(struct gw_node) );
 
-	gw_node = debugMalloc( sizeof(struct gw_node), 103 );
-	memset( gw_node, 0, sizeof(struct gw_node) );
-	INIT_LIST_HEAD( &gw_node->list );
+		gw_node->orig_node = orig_node;
+		gw_node->unavail_factor = 0;
+		gw_node->last_failure = get_time();
 
-	gw_node->orig_node = orig_node;
-	gw_node->unavail_factor = 0;
-	gw_node->last_failure = get_time();
+		/* a score of 0 - the tail of the list */
+		dlist_add_tail( &gw_node->list, &gw_list );
+		orig_node->gw_node = gw_node;
 
-	list_add_tail( &gw_node->list, &gw_list );
+	}
 
-// 	choose_gw();
+	orig_node->gwflags = new_gwflags;
+	gw_node_update( gw_node );
 
 }
 
@@ -468,64 +622,21 @@ int isBntog( uint8_t *neigh, struct orig_node *orig_tog_node ) {
 
 
 
-int isBidirectionalNeigh(struct orig_node *orig_node, struct orig_node *orig_neigh_node, struct batman_packet *in, uint32_t recv_time, struct batman_if *if_incoming)
+int isBidirectionalNeigh(struct orig_node *orig_node, struct orig_node *orig_neigh_node, struct batman_packet *in, uint32_t recv_time, struct link_node *link_node)
 {
-	struct list_head *list_pos;
-	struct neigh_node *neigh_node = NULL, *tmp_neigh_node = NULL;
-	uint8_t total_count;
+	uint16_t total_count;
 	char str1[ETH_STR_LEN], str2[ETH_STR_LEN];
 
 
-	if (orig_node == orig_neigh_node) {
-
-		list_for_each(list_pos, &orig_node->neigh_list) {
-			tmp_neigh_node = list_entry(list_pos, struct neigh_node, list);
-
-			if ((compare_orig(tmp_neigh_node->addr, orig_neigh_node->orig) == 0) && (tmp_neigh_node->if_incoming == if_incoming) )
-				neigh_node = tmp_neigh_node;
-		}
-
-		if (neigh_node == NULL)
-			neigh_node = create_neighbor(orig_node, orig_neigh_node, orig_neigh_node->orig, if_incoming);
-
-		neigh_node->last_valid = recv_time;
-	} else {
-		/* find packet count of corresponding one hop neighbor */
-		list_for_each(list_pos, &orig_neigh_node->neigh_list) {
-			tmp_neigh_node = list_entry(list_pos, struct neigh_node, list);
-
-			if ((compare_orig(tmp_neigh_node->addr, orig_neigh_node->orig) == 0) && (tmp_neigh_node->if_incoming == if_incoming))
-				neigh_node = tmp_neigh_node;
-		}
-
-		if ( neigh_node == NULL )
-			neigh_node = create_neighbor(orig_neigh_node, orig_neigh_node, orig_neigh_node->orig, if_incoming);
-	}
-
-	orig_node->last_valid = recv_time;
-
-	/* pay attention to not get a value bigger than 100 % */
-	total_count = (orig_neigh_node->bcast_own_sum[if_incoming->if_num] > neigh_node->real_packet_count ? neigh_node->real_packet_count : orig_neigh_node->bcast_own_sum[if_incoming->if_num]);
+	orig_node_refresh(orig_node, recv_time);
 
-	/* if we have too few packets (too less data) we set tq_own to zero */
-	/* if we receive too few packets it is not considered bidirectional */
-	if ((total_count < TQ_LOCAL_BIDRECT_SEND_MINIMUM) || (neigh_node->real_packet_count < TQ_LOCAL_BIDRECT_RECV_MINIMUM))
-		orig_neigh_node->tq_own = 0;
-	else
-		/* neigh_node->real_packet_count is never zero as we only purge old information when getting new information */
-		orig_neigh_node->tq_own = (TQ_MAX_VALUE * total_count) / neigh_node->real_packet_count;
+	/* shift out the packets of this neighbour we did not receive since we last looked at the link */
+	link_sync_real_bits(orig_neigh_node, link_node);
 
-	/* 1 - ((1-x)** 3), normalized to TQ_MAX_VALUE */
-	/* this does affect the nearly-symmetric links only a little,
-	* but punishes asymetric links more. */
-	/* this will give a value between 0 and TQ_MAX_VALUE */
-	orig_neigh_node->tq_asym_penalty = TQ_MAX_VALUE - (TQ_MAX_VALUE *
-			(TQ_LOCAL_WINDOW_SIZE - neigh_node->real_packet_count) *
-			(TQ_LOCAL_WINDOW_SIZE - neigh_node->real_packet_count) *
-			(TQ_LOCAL_WINDOW_SIZE - neigh_node->real_packet_count)) /
-			(TQ_LOCAL_WINDOW_SIZE * TQ_LOCAL_WINDOW_SIZE * TQ_LOCAL_WINDOW_SIZE);
+	total_count = bcast_own_sync(link_node);
 
-	in->tq = ((in->tq * orig_neigh_node->tq_own * orig_neigh_node->tq_asym_penalty) / (TQ_MAX_VALUE *  TQ_MAX_VALUE));
+	/* the link quality and how it affects the path depend on the metric (see -m) */
+	in->tq = metric->combine(in->tq, metric->link_quality(link_node, total_count));
 
 	/*static char orig_str[ADDR_STR_LEN], neigh_str[ADDR_STR_LEN];
 	addr_to_string( orig_node->orig, orig_str, ADDR_STR_LEN );
@@ -536,7 +647,7 @@ int isBidirectionalNeigh(struct orig_node *orig_node, struct orig_node *orig_nei
 	addr_to_string(str1, orig_node->orig);
 	addr_to_string(str2, orig_neigh_node->orig);
 	debug_output( 4, "bidirectional: orig = %-15s neigh = %-15s => own_bcast = %2i, real recv = %2i, local tq: %3i, asym_penality: %3i, total tq: %3i \n",
-		      str1, str2, total_count, neigh_node->real_packet_count, orig_neigh_node->tq_own, orig_neigh_node->tq_asym_penalty, in->tq );
+		      str1, str2, total_count, link_node->real_packet_count, link_node->tq_own, link_node->tq_asym_penalty, in->tq );
 
 	/* if link has the minimum required transmission quality consider it bidirectional */
 	if (in->tq >= TQ_TOTAL_BIDRECT_LIMIT)
@@ -569,11 +680,11 @@ int is_my_mac( uint8_t *addr ) {
 
 void generate_vis_packet() {
 
-	struct hash_it_t *hashit = NULL;
 	struct orig_node *orig_node;
 	struct vis_data *vis_data;
 	struct list_head *list_pos;
 	struct batman_if *batman_if;
+	uint32_t j;
 	int i;
 
 
@@ -595,12 +706,12 @@ void generate_vis_packet() {
 	((struct vis_packet *)vis_packet)->seq_range = TQ_MAX_VALUE;
 
 	/* neighbor list */
-	while ( NULL != ( hashit = hash_iterate( orig_hash, hashit ) ) ) {
+	for ( j = 0; j < orig_num; j++ ) {
 
-		orig_node = hashit->bucket->data;
+		orig_node = orig_index[j];
 
 		/* we interested in 1 hop neighbours only */
-		if ( ( orig_node->router != NULL ) && ( memcmp(orig_node->orig, orig_node->router->addr, 6) == 0 ) && ( orig_node->router->tq_avg > 0 ) ) {
+		if ( ( orig_node->router != NULL ) && ( memcmp(orig_node->orig, orig_node->router->link->addr, 6) == 0 ) && ( orig_node->router->tq_avg > 0 ) ) {
 
 			vis_packet_size += sizeof(struct vis_data);
 
@@ -683,12 +794,10 @@ void send_vis_packet() {
 
 }
 
-uint8_t count_real_packets(uint8_t *neigh, struct batman_packet *in, struct batman_if *if_incoming)
+uint8_t count_real_packets(struct link_node *link_node, struct batman_packet *in)
 {
-	struct list_head *list_pos;
 	struct orig_node *orig_node;
-	struct neigh_node *tmp_neigh_node;
-	uint8_t is_duplicate = 0;
+	uint8_t is_duplicate;
 
 
 	orig_node = get_orig_node(in->orig);
@@ -700,232 +809,307 @@ uint8_t count_real_packets(uint8_t *neigh, struct batman_packet *in, struct batm
 
 	debug_output( 3, "count_real_packets: orig = %s, neigh = %s, seq = %i, last seq = %i\n", orig_str, neigh_str, in->seqno, orig_node->last_real_seqno );*/
 
-	list_for_each(list_pos, &orig_node->neigh_list) {
-		tmp_neigh_node = list_entry(list_pos, struct neigh_node, list);
-
-		if (!is_duplicate)
-			is_duplicate = get_bit_status(tmp_neigh_node->real_bits, orig_node->last_real_seqno, in->seqno);
-
-		if ((compare_orig(tmp_neigh_node->addr, neigh) == 0) && (tmp_neigh_node->if_incoming == if_incoming))
-			bit_get_packet(tmp_neigh_node->real_bits, in->seqno - orig_node->last_real_seqno, 1);
-		else
-			bit_get_packet(tmp_neigh_node->real_bits, in->seqno - orig_node->last_real_seqno, 0);
-
-		tmp_neigh_node->real_packet_count = bit_packet_count(tmp_neigh_node->real_bits);
-	}
+	is_duplicate = get_bit_status(orig_node->real_bits, orig_node->last_real_seqno, in->seqno);
 
-	if (!is_duplicate) {
+	if (bit_get_packet(orig_node->real_bits, in->seqno - orig_node->last_real_seqno, 1)) {
 		debug_output( 4, "updating last_seqno: old %d, new %d \n", orig_node->last_real_seqno, in->seqno );
 		orig_node->last_real_seqno = in->seqno;
 	}
 
+	/* only the own packets of a neighbour are counted for the link quality (see isBidirectionalNeigh()) */
+	if (compare_orig(link_node->addr, in->orig) == 0)
+		link_mark_real_bit(orig_node, link_node, in->seqno);
+
 	return is_duplicate;
 }
 
-int8_t batman() {
-
-	struct list_head *if_pos, *forw_pos, *forw_pos_tmp;
+/* process a single OGM - several of them may have been aggregated into one frame */
+static void process_ogm(struct batman_packet *batman_packet, int16_t ogm_len, uint8_t *neigh, struct batman_if *if_incoming)
+{
+	struct list_head *if_pos;
 	struct orig_node *orig_neigh_node, *orig_node;
-	struct batman_if *batman_if, *if_incoming;
-	struct forw_node *forw_node;
-	uint32_t debug_timeout, select_timeout;
-	unsigned char in[2000];
+	struct link_node *link_node = NULL;
+	struct batman_if *batman_if;
 	char str1[ETH_STR_LEN], str2[ETH_STR_LEN], str3[ETH_STR_LEN];
-	int16_t in_len;
 	int16_t in_hna_len;
 	uint8_t *in_hna_buff;
-	uint8_t neigh[6], is_my_addr, is_my_orig, is_my_oldorig, is_broadcast, is_duplicate, is_bidirectional, is_single_hop_neigh, has_directlink_flag;
-	int8_t res;
+	uint8_t is_my_addr, is_my_orig, is_my_oldorig, is_broadcast, is_duplicate, is_bidirectional, is_single_hop_neigh, has_directlink_flag;
 
-	debug_timeout = get_time();
 
-	if ( NULL == ( orig_hash = hash_new( 128, compare_orig, choose_orig ) ) )
-		return(-1);
+	is_my_addr = is_my_orig = is_my_oldorig = is_broadcast = is_duplicate = is_bidirectional = 0;
+
+	has_directlink_flag = batman_packet->flags & DIRECTLINK ? 1 : 0;
+
+	is_single_hop_neigh = (compare_orig(neigh, batman_packet->orig) == 0 ? 1 : 0);
+
+	in_hna_buff = (uint8_t *)(batman_packet + 1);
+	in_hna_len = ogm_len - sizeof(struct batman_packet);
+
+	addr_to_string(str1, neigh);
+	addr_to_string(str2, if_incoming->hw_addr);
+	addr_to_string(str3, batman_packet->orig);
+
+	debug_output( 4, "Received BATMAN packet via NB: %s ,IF: %s %s (from OG: %s, seqno %d, TTL %d, V %d, IDF %d) \n",
+			str1,
+			if_incoming->dev,
+			str2,
+			str3,
+			batman_packet->seqno,
+			batman_packet->ttl,
+			batman_packet->version,
+			has_directlink_flag );
 
 	list_for_each( if_pos, &if_list ) {
 
-		batman_if = list_entry( if_pos, struct batman_if, list );
+		batman_if = list_entry(if_pos, struct batman_if, list);
 
-		batman_if->out.packet_type = BAT_PACKET;
-		batman_if->out.version = COMPAT_VERSION;
-		batman_if->out.flags = 0x00;
-		batman_if->out.ttl = TTL;
-		batman_if->out.gwflags = gateway_class;
-		batman_if->out.tq = TQ_MAX_VALUE;
-		batman_if->out.seqno = 1;
-		batman_if->out.num_hna = 0;
+		if ( compare_orig( neigh, batman_if->hw_addr ) == 0 )
+			is_my_addr = 1;
 
-		memcpy(batman_if->out.orig, batman_if->hw_addr, 6);
-		memcpy(batman_if->out.old_orig, batman_if->hw_addr, 6);
+		if ( compare_orig( batman_packet->orig, batman_if->hw_addr ) == 0 )
+			is_my_orig = 1;
 
-		batman_if->bcast_seqno = 1;
+		if (compare_orig(batman_packet->old_orig, batman_if->hw_addr) == 0)
+			is_my_oldorig = 1;
 
-		schedule_own_packet( batman_if );
+		if ( compare_orig( neigh, broadcastAddr ) == 0 )
+			is_broadcast = 1;
 
 	}
 
-	if ( -1 == transtable_init())
-		return(-1);
+	if ( batman_packet->gwflags != 0 )
+		debug_output( 4, "Is an internet gateway (class %i) \n", batman_packet->gwflags );
 
-	while ( !is_aborted() ) {
+	/* every packet of a neighbour keeps its link alive - even the echos of our own packets */
+	if ( ( batman_packet->version == COMPAT_VERSION ) && ( !is_my_addr ) && ( !is_broadcast ) ) {
 
-		debug_output( 4, " \n \n" );
+		link_node = get_link_node( neigh, if_incoming );
+		link_node_refresh( link_node, curr_time );
 
-		/* harden select_timeout against sudden time change (e.g. ntpdate) */
-		curr_time = get_time();
-		select_timeout = ( curr_time < ((struct forw_node *)forw_list.next)->send_time ? ((struct forw_node *)forw_list.next)->send_time - curr_time : 10 );
+	}
 
-		res = receive_packet( in, sizeof(in), &in_len, neigh, select_timeout, &if_incoming );
 
-		if ( res < 0 )
-			return -1;
+	if ( batman_packet->version != COMPAT_VERSION ) {
 
-		if ( res > 0 ) {
+		debug_output( 4, "Drop packet: incompatible batman version (%i) \n", batman_packet->version );
 
-			curr_time = get_time();
+	} else if ( is_my_addr ) {
+
+		debug_output(4, "Drop packet: received my own broadcast (sender: %s)\n", str1);
 
-			is_my_addr = is_my_orig = is_my_oldorig = is_broadcast = is_duplicate = is_bidirectional = 0;
+	} else if ( is_broadcast ) {
 
-			has_directlink_flag = ((struct batman_packet *)&in)->flags & DIRECTLINK ? 1 : 0;
+		debug_output( 4, "Drop packet: ignoring all packets with broadcast source IP (sender: %s)\n", str1);
 
-			is_single_hop_neigh = (compare_orig(neigh, ((struct batman_packet *)&in)->orig) == 0 ? 1 : 0);
+	} else if ( is_my_orig ) {
 
-			in_hna_buff = in + sizeof(struct batman_packet);
-			in_hna_len = in_len - sizeof(struct batman_packet);
+		/* neighbour has to indicate direct link and it has to come via the corresponding interface */
+		/* if received seqno equals last send seqno save new seqno for bidirectional check */
+		if (has_directlink_flag && (batman_packet->seqno - if_incoming->out.seqno + 2 == 0))
+			bcast_own_mark(link_node);
 
-			addr_to_string(str1, neigh);
-			addr_to_string(str2, if_incoming->hw_addr);
-			addr_to_string(str3, ((struct batman_packet *)&in)->orig);
+		debug_output( 4, "Drop packet: originator packet from myself (via neighbour) \n" );
 
-			debug_output( 4, "Received BATMAN packet via NB: %s ,IF: %s %s (from OG: %s, seqno %d, TTL %d, V %d, IDF %d) \n",
-					str1,
-					if_incoming->dev,
-					str2,
-					str3,
-					((struct batman_packet *)&in)->seqno,
-					((struct batman_packet *)&in)->ttl,
-					((struct batman_packet *)&in)->version,
-					has_directlink_flag );
+	} else if (batman_packet->tq == 0) {
 
-			list_for_each( if_pos, &if_list ) {
+		count_real_packets(link_node, batman_packet);
 
-				batman_if = list_entry(if_pos, struct batman_if, list);
+		debug_output(4, "Drop packet: originator packet with tq equal 0 \n");
 
-				if ( compare_orig( neigh, batman_if->hw_addr ) == 0 )
-					is_my_addr = 1;
+	} else if (is_my_oldorig) {
 
-				if ( compare_orig( ((struct batman_packet *)&in)->orig, batman_if->hw_addr ) == 0 )
-					is_my_orig = 1;
+		debug_output(4, "Drop packet: ignoring all rebroadcast echos (sender: %s) \n", str1);
 
-				if (compare_orig(((struct batman_packet *)&in)->old_orig, batman_if->hw_addr) == 0)
-					is_my_oldorig = 1;
+	} else {
+		is_duplicate = count_real_packets(link_node, batman_packet);
 
-				if ( compare_orig( neigh, broadcastAddr ) == 0 )
-					is_broadcast = 1;
+		orig_node = get_orig_node( batman_packet->orig );
 
-			}
+		/* if sender is a direct neighbor the sender mac equals originator mac */
+		orig_neigh_node = (is_single_hop_neigh ? orig_node : get_orig_node(neigh));
 
-			if ( ((struct batman_packet *)&in)->gwflags != 0 )
-				debug_output( 4, "Is an internet gateway (class %i) \n", ((struct batman_packet *)&in)->gwflags );
+		/* drop packet if sender is not a direct neighbor and if we no route towards it */
+		if (!is_single_hop_neigh && (orig_neigh_node->router == NULL)) {
 
+			debug_output( 4, "Drop packet: OGM via unkown neighbor! \n" );
 
-			if ( ((struct batman_packet *)&in)->version != COMPAT_VERSION ) {
+		} else {
 
-				debug_output( 4, "Drop packet: incompatible batman version (%i) \n", ((struct batman_packet *)&in)->version );
+			is_bidirectional = isBidirectionalNeigh(orig_node, orig_neigh_node, batman_packet, curr_time, link_node);
 
-			} else if ( is_my_addr ) {
+			/* update ranking if it is not a duplicate or has the same seqno and similar ttl as the non-duplicate */
+			if (is_bidirectional && (!is_duplicate || ((orig_node->last_real_seqno == batman_packet->seqno) && (orig_node->last_ttl - 3 <= batman_packet->ttl))))
+				update_orig(orig_node, link_node, batman_packet, in_hna_buff, in_hna_len, is_duplicate, curr_time);
 
-				debug_output(4, "Drop packet: received my own broadcast (sender: %s)\n", str1);
+			/* is single hop (direct) neighbour */
+			if (is_single_hop_neigh) {
+
+				/* mark direct link on incoming interface */
+				schedule_forward_packet(orig_node, neigh, batman_packet, 1, ogm_len, if_incoming);
+
+				debug_output(4, "Forward packet: rebroadcast neighbour packet with direct link flag \n" );
+
+			/* multihop originator */
+			} else {
 
-			} else if ( is_broadcast ) {
+				if (is_bidirectional) {
 
-				debug_output( 4, "Drop packet: ignoring all packets with broadcast source IP (sender: %s)\n", str1);
+					if (!is_duplicate) {
+
+						schedule_forward_packet(orig_node, neigh, batman_packet, 0, ogm_len, if_incoming);
+
+						debug_output(4, "Forward packet: rebroadcast originator packet \n" );
+
+					} else {
+
+						debug_output(4, "Drop packet: duplicate packet received\n" );
+
+					}
 
-			} else if ( is_my_orig ) {
+				} else {
 
-				orig_neigh_node = get_orig_node( neigh );
+					debug_output(4, "Drop packet: not received via bidirectional link\n" );
 
-				/* neighbour has to indicate direct link and it has to come via the corresponding interface */
-				/* if received seqno equals last send seqno save new seqno for bidirectional check */
-				if (has_directlink_flag && (((struct batman_packet *)&in)->seqno - if_incoming->out.seqno + 2 == 0)) {
-					bit_mark((TYPE_OF_WORD *)&(orig_neigh_node->bcast_own[if_incoming->if_num * NUM_WORDS]), 0);
-					orig_neigh_node->bcast_own_sum[if_incoming->if_num] = bit_packet_count((TYPE_OF_WORD *)&(orig_neigh_node->bcast_own[if_incoming->if_num * NUM_WORDS]));
 				}
 
-				debug_output( 4, "Drop packet: originator packet from myself (via neighbour) \n" );
+			}
 
-			} else if (((struct batman_packet *)&in)->tq == 0) {
+		}
+	}
+}
 
-				count_real_packets(neigh, (struct batman_packet *)&in, if_incoming);
+int8_t batman() {
 
-				debug_output(4, "Drop packet: originator packet with tq equal 0 \n");
+	struct list_head *if_pos, *forw_pos, *forw_pos_tmp;
+	struct batman_if *batman_if, *if_incoming;
+	struct forw_node *forw_node;
+	uint32_t debug_timeout, probe_timeout, snapshot_timeout, select_timeout;
+	unsigned char in[2000], *ogm_ptr;
+	int16_t in_len, ogm_len;
+	uint8_t neigh[6];
+	int8_t res;
+	int i;
 
-			} else if (is_my_oldorig) {
+	debug_timeout = probe_timeout = snapshot_timeout = get_time();
 
-				debug_output(4, "Drop packet: ignoring all rebroadcast echos (sender: %s) \n", str1);
+	for ( i = 0; i < ORIG_HASH_SHARDS; i++ ) {
 
-			} else {
-				is_duplicate = count_real_packets(neigh, (struct batman_packet *)&in, if_incoming);
+		if ( NULL == ( orig_hash[i] = hash_new( 16, compare_orig, choose_orig ) ) )
+			return(-1);
 
-				orig_node = get_orig_node( ((struct batman_packet *)&in)->orig );
+	}
 
-				/* if sender is a direct neighbor the sender mac equals originator mac */
-				orig_neigh_node = (is_single_hop_neigh ? orig_node : get_orig_node(neigh));
+	if ( NULL == ( forw_hash = hash_new( 128, compare_forw, choose_forw ) ) )
+		return(-1);
 
-				/* drop packet if sender is not a direct neighbor and if we no route towards it */
-				if (!is_single_hop_neigh && (orig_neigh_node->router == NULL)) {
+	pool_init( &forw_pool, "forw_node", sizeof(struct forw_node), POOL_SLAB, 505 );
 
-					debug_output( 4, "Drop packet: OGM via unkown neighbor! \n" );
+	/* the window sizes are known now */
+	pool_init( &orig_pool, "orig_node", sizeof(struct orig_node) + 2 * local_win_words * sizeof(TYPE_OF_WORD) + found_ifs * sizeof(struct neigh_node *), POOL_SLAB, 401 );
+	pool_init( &neigh_pool, "neigh_node", sizeof(struct neigh_node) + ( tq_ewma_shift ? 0 : global_win_size ), POOL_SLAB, 403 );
+	pool_init( &link_pool, "link_node", sizeof(struct link_node) + 2 * local_win_words * sizeof(TYPE_OF_WORD), POOL_SLAB, 405 );
 
-				} else {
+	if ( NULL == ( link_hash = hash_new( 128, compare_link, choose_link ) ) )
+		return(-1);
 
-					is_bidirectional = isBidirectionalNeigh(orig_node, orig_neigh_node, (struct batman_packet *)&in, curr_time, if_incoming);
+	metric_init( metric_engine );
 
-					/* update ranking if it is not a duplicate or has the same seqno and similar ttl as the non-duplicate */
-					if (is_bidirectional && (!is_duplicate || ((orig_node->last_real_seqno == ((struct batman_packet *)&in)->seqno) && (orig_node->last_ttl - 3 <= ((struct batman_packet *)&in)->ttl))))
-						update_orig(orig_node, neigh, (struct batman_packet *)&in, if_incoming, in_hna_buff, in_hna_len, is_duplicate, curr_time);
+	list_for_each( if_pos, &if_list ) {
 
-					/* is single hop (direct) neighbour */
-					if (is_single_hop_neigh) {
+		batman_if = list_entry( if_pos, struct batman_if, list );
 
-						/* mark direct link on incoming interface */
-						schedule_forward_packet(orig_node, neigh, (struct batman_packet *)&in, 1, in_len, if_incoming);
+		batman_if->out.packet_type = BAT_PACKET;
+		batman_if->out.version = COMPAT_VERSION;
+		batman_if->out.flags = 0x00;
+		batman_if->out.ttl = ttl;
+		batman_if->out.gwflags = gateway_class;
+		batman_if->out.tq = TQ_MAX_VALUE;
+		batman_if->out.seqno = 1;
+		batman_if->out.num_hna = 0;
 
-						debug_output(4, "Forward packet: rebroadcast neighbour packet with direct link flag \n" );
+		memcpy(batman_if->out.orig, batman_if->hw_addr, 6);
+		memcpy(batman_if->out.old_orig, batman_if->hw_addr, 6);
 
-					/* multihop originator */
-					} else {
+		batman_if->bcast_seqno = 1;
+
+	}
 
-						if (is_bidirectional) {
+	if ( -1 == transtable_init())
+		return(-1);
 
-							if (!is_duplicate) {
+	/* continue where the last run stopped (see -S) */
+	if ( snapshot_file != NULL )
+		snapshot_load();
 
-								schedule_forward_packet(orig_node, neigh, (struct batman_packet *)&in, 0, in_len, if_incoming);
+	bootstrap_start();
 
-								debug_output(4, "Forward packet: rebroadcast originator packet \n" );
+	list_for_each( if_pos, &if_list ) {
 
-							} else {
+		batman_if = list_entry( if_pos, struct batman_if, list );
 
-								debug_output(4, "Drop packet: duplicate packet received\n" );
+		schedule_own_packet( batman_if );
 
-							}
+	}
 
-						} else {
+	while ( !is_aborted() ) {
 
-							debug_output(4, "Drop packet: not received via bidirectional link\n" );
+		debug_output( 4, " \n \n" );
 
-						}
+		/* harden select_timeout against sudden time change (e.g. ntpdate) */
+		curr_time = get_time();
+		select_timeout = ( curr_time < ((struct forw_node *)forw_list.next)->send_time ? ((struct forw_node *)forw_list.next)->send_time - curr_time : 10 );
 
-					}
+		res = receive_packet( in, sizeof(in), &in_len, neigh, select_timeout, &if_incoming );
+
+		if ( res < 0 )
+			return -1;
+
+		if ( res > 0 ) {
+
+			curr_time = get_time();
+
+			ogm_ptr = in;
+
+			/* de-aggregate: every OGM is followed by its HNA entries (the rest might be ethernet padding) */
+			while ( ( in_len >= (int16_t)sizeof(struct batman_packet) ) && ( ((struct batman_packet *)ogm_ptr)->packet_type == BAT_PACKET ) ) {
+
+				ogm_len = sizeof(struct batman_packet) + ((struct batman_packet *)ogm_ptr)->num_hna * ETH_ALEN;
+
+				if ( ogm_len > in_len )
+					ogm_len = in_len;
+
+				((struct batman_packet *)ogm_ptr)->seqno = ntohs( ((struct batman_packet *)ogm_ptr)->seqno ); /* network to host order for our 16bit seqno. */
+
+				process_ogm( (struct batman_packet *)ogm_ptr, ogm_len, neigh, if_incoming );
+
+				ogm_ptr += ogm_len;
+				in_len -= ogm_len;
 
-				}
 			}
+
 		}
 
 
+		/* parameters changed via the unix socket */
+		config_apply_pending();
+
 		hna_update(curr_time);
 		send_outstanding_packets();
 
+		if ( ( metric_engine == METRIC_THROUGHPUT ) && ( probe_interval > 0 ) && ( probe_timeout + probe_interval < curr_time ) ) {
+
+			probe_timeout = curr_time;
+			send_probes();
+
+		}
+
+		if ( ( snapshot_file != NULL ) && ( snapshot_timeout + SNAPSHOT_INTERVAL < curr_time ) ) {
+
+			snapshot_timeout = curr_time;
+			snapshot_save( 0 );
+
+		}
+
 		if (debug_timeout+1000 < curr_time) {
 
 			debug_timeout = curr_time;
@@ -933,9 +1117,6 @@ int8_t batman() {
 			debug_orig();
 			checkIntegrity();
 
-// 			if ( ( routing_class != 0 ) && ( curr_gateway == NULL ) )
-// 				choose_gw();
-
  			if ( vis_if.sock )
  				send_vis_packet();
 
@@ -944,12 +1125,25 @@ int8_t batman() {
 	}
 
 
+	if ( snapshot_file != NULL )
+		snapshot_save( 1 );
+
 	if ( debug_level > 0 )
 		printf( "Deleting all BATMAN routes\n" );
 
-	purge_orig( get_time() + ( 5 * PURGE_TIMEOUT ) + originator_interval );
+	purge_orig( get_time() + ( 5 * purge_timeout ) + originator_interval );
+
+	for ( i = 0; i < ORIG_HASH_SHARDS; i++ )
+		hash_destroy( orig_hash[i] );
 
-	hash_destroy( orig_hash );
+	hash_destroy( link_hash );
+
+	if ( orig_index != NULL )
+		debugFree( orig_index, 1408 );
+
+	pool_destroy( &orig_pool );
+	pool_destroy( &neigh_pool );
+	pool_destroy( &link_pool );
 	transtable_quit();
 
 
@@ -958,11 +1152,13 @@ int8_t batman() {
 
 		list_del( (struct list_head *)&forw_list, forw_pos, &forw_list );
 
-		debugFree( forw_node->pack_buff, 1110 );
-		debugFree( forw_node, 1111 );
+		forw_node_free( forw_node );
 
 	}
 
+	hash_delete( forw_hash, NULL );
+	pool_destroy( &forw_pool );
+
 
 	return 0;
 
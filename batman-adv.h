@@ -30,7 +30,9 @@
 #include "list-batman.h"
 #include "dlist.h"
 #include "bitarray.h"
+#include "ring_buffer.h"
 #include "hash.h"
+#include "pool.h"
 #include "allocate.h"
 #include "packet.h"
 #include "dlist.h"
@@ -77,30 +79,83 @@
 
 
 /*
- * No configuration files or fancy command line switches yet
- * To experiment with B.A.T.M.A.N. settings change them here
- * and recompile the code
+ * The defaults of the protocol parameters - most of them can be set at startup
+ * and changed at runtime (see -O and config.c)
  * Here is the stuff you may want to play with:
  */
 
-#define JITTER 100
-#define TTL 50                /* Time To Live of broadcast messages */
-#define PURGE_TIMEOUT 200000  /* purge originators after time in ms if no valid packet comes in -> TODO: check influence on TQ_LOCAL_WINDOW_SIZE */
+#define JITTER 100            /* default: own OGMs are sent up to this many ms before or after the originator interval */
+#define TTL 50                /* default Time To Live of broadcast messages */
+#define PURGE_TIMEOUT 200000  /* default: purge originators after time in ms if no valid packet comes in -> TODO: check influence on TQ_LOCAL_WINDOW_SIZE */
+#define PURGE_TIMEOUT_MIN 10000
+#define PURGE_TIMEOUT_MAX 3600000
 #define TQ_MAX_VALUE 255
-#define TQ_LOCAL_WINDOW_SIZE 64     /* sliding packet range of received originator messages in squence numbers (should be a multiple of our word size) */
-#define TQ_GLOBAL_WINDOW_SIZE 10
+#define TQ_LOCAL_WINDOW_SIZE 64     /* default sliding packet range of received originator messages in squence numbers (see -w) */
+#define TQ_LOCAL_WINDOW_MIN 8
+#define TQ_LOCAL_WINDOW_MAX 256
+#define TQ_GLOBAL_WINDOW_SIZE 10     /* default number of tq values a neighbour ranking is averaged over (see -W) */
+#define TQ_GLOBAL_WINDOW_MAX 255
+#define TQ_EWMA_SHIFT_MAX 7
 #define TQ_LOCAL_BIDRECT_SEND_MINIMUM 1
 #define TQ_LOCAL_BIDRECT_RECV_MINIMUM 1
 #define TQ_TOTAL_BIDRECT_LIMIT 1
 
-#define TQ_HOP_PENALTY 10
+#define TQ_HOP_PENALTY 10           /* default tq reduction per hop in 1/255 */
 
-#define PACKETS_PER_CYCLE 10  /* this seems to be a reasonable value (i've tested for different setups) */
+#define ORIG_INTERVAL_LIMIT (purge_timeout / 10 < INT16_MAX ? purge_timeout / 10 : INT16_MAX)  /* adaptive originator interval: upper limit of -A so that nobody times out our node */
+#define ORIG_INTERVAL_GROWTH 4                    /* grow the interval by 1/4 with every own packet sent while the topology is stable */
+#define ORIG_INTERVAL_TQ_DELTA 16                 /* a router tq change by more than this is considered a topology change */
+
+#define BOOTSTRAP_OGMS 5          /* own OGMs sent in quick succession at startup and when a new neighbour shows up */
+#define BOOTSTRAP_INTERVAL 250    /* in ms, plus up to JITTER */
+#define BOOTSTRAP_HOLDOFF 10000   /* at most one bootstrap burst within this many ms - new neighbours keep coming in big meshes */
+
+#define ROUTE_HOLD_TIME_MAX (purge_timeout / 10 < UINT16_MAX ? purge_timeout / 10 : UINT16_MAX)  /* route hysteresis: upper limit of -Y */
+
+#define BONDING_OFF 0            /* unicast packets towards an originator are sent via its router only (see -B) */
+#define BONDING_ROUND_ROBIN 1    /* spread them packet by packet over the routers within -T of the best one */
+#define BONDING_FLOW_HASH 2      /* spread them by a hash over the addresses and ports - the packets of one flow stay in order */
+
+#define GW_CLASS_MAX 11           /* highest gateway class (see gw2string) */
+#define GW_SWITCH_THRESHOLD 20    /* another gateway has to be better than the current one by this many percent to replace it */
+
+#define DHCP_SERVER_PORT 67
+#define DHCP_CLIENT_PORT 68
+#define DHCP_DISCOVER 1           /* DHCP message types (option 53) */
+#define DHCP_OFFER 2
+#define DHCP_REQUEST 3
+
+#define METRIC_TQ 0              /* routing metric (see -m): transmit quality derived from the OGM delivery ratio */
+#define METRIC_THROUGHPUT 1      /* routing metric (see -m): bottleneck throughput of the path, measured by link probes */
+#define PROBE_INTERVAL 10000     /* default interval of the link probe bursts in ms (see -P) */
+#define PROBE_INTERVAL_MAX (purge_timeout / 10 < UINT16_MAX ? purge_timeout / 10 : UINT16_MAX)
+#define PROBE_PACKETS 4          /* probes sent back to back per burst - the throughput is derived from their spacing */
+#define PROBE_SIZE 1000          /* size of a probe, limited by the mtu of the interface */
+#define THROUGHPUT_DEFAULT 1000  /* kbit/s assumed for a link until its first probe burst was measured */
+#define THROUGHPUT_EWMA_SHIFT 2  /* new throughput measurements are weighted with 1/4 */
+#define THROUGHPUT_HOP_PENALTY 1 /* throughput metric: one encoding step (about 9 %) per hop (see probe_encode()) */
+
+#define SNAPSHOT_INTERVAL 10000  /* the routing state is saved this often in ms (see -S) */
+#define SNAPSHOT_MAX_AGE (purge_timeout / 1000)  /* older snapshots are ignored at startup (in s) */
+
+#define FISHEYE_MAX_SHIFT 3     /* fisheye: far away nodes still get every 2^3rd OGM (see -f) */
+
+#define FORW_LIST_MAX 1000      /* forwarded OGMs which may be queued at once - the rest is dropped */
+#define FORW_BUFF_INLINE (sizeof(struct batman_packet) + 16 * ETH_ALEN)  /* OGMs up to this size are kept within their forw_node */
+
+#define MAX_AGGREGATION_MS 100  /* OGMs due within this time are sent in one frame, forwarded OGMs wait as long (see -a) */
+
+#define ORIG_HASH_SHARDS 16     /* the originators are spread over this many hashes by their mac address (see ORIG_SHARD()) */
+#define ORIG_SHARD(addr) ( ( (addr)[4] ^ (addr)[5] ) % ORIG_HASH_SHARDS )  /* other bytes than choose_orig() mostly depends on */
+
+#define POOL_SLAB 64           /* objects allocated at once by the pools of the originators, neighbours, links and forw_nodes */
+
+#define PACKETS_PER_CYCLE 10  /* default - this seems to be a reasonable value (i've tested for different setups) */
 							  /* how many packets to read from the virtual interfaces, maximum.
 							   * low value = high throughput, high CPU-load
 							   * big value = low throughput, low CPU-load
 							   * infinity = as it was before. */
-#define BROADCAST_UNKNOWN_DEST	1
+#define BROADCAST_UNKNOWN_DEST	1	/* default */
 							  /* if a packet with unknown destination should be sent, that means the port
 							   * can not be looked up in the translation table, a switch usually
 							   * broadcasts the packet. This should happen very rarely, as the switch
@@ -113,10 +168,10 @@
 								/* maximum size of a packet which carries payload. This should be calculated by the compiler.*/
 #define BATMAN_MAXFRAMESIZE		(sizeof(struct ether_header) + BATMAN_MAXPACKETSIZE)	/* size of an ethernet frame. */
 
-#define NUM_WORDS (TQ_LOCAL_WINDOW_SIZE / WORD_BIT_SIZE)
+#define NUM_WORDS local_win_words
 
 #define AGE_THRESHOLD		3600000
-			/* purge from local hna list after 60 minutes. */
+			/* default: purge from local hna list after 60 minutes. */
 
 #define ETH_STR_LEN 20
 
@@ -128,8 +183,36 @@ extern uint8_t debug_level_max;
 extern uint8_t gateway_class;
 extern uint8_t routing_class;
 extern int16_t originator_interval;
+extern int16_t originator_interval_max;
+extern int16_t originator_interval_curr;
+extern uint16_t local_win_size;
+extern uint8_t local_win_words;
+extern uint8_t global_win_size;
+extern uint8_t tq_ewma_shift;
+extern uint16_t jitter;
+extern uint8_t ttl;
+extern int32_t purge_timeout;
+extern uint8_t hop_penalty;
+extern uint16_t packets_per_cycle;
+extern uint32_t age_threshold;
+extern uint8_t bcast_unknown_dest;
+extern uint8_t aggregation_enabled;
+extern uint8_t fisheye_radius;
+extern uint8_t route_hyst_tq;
+extern uint16_t route_hold_time;
+extern uint32_t route_changes_kept;
+extern uint8_t if_alt_margin;
+extern uint8_t bonding_mode;
+extern uint8_t bonding_tolerance;
+extern uint32_t if_alt_packets;
+extern uint8_t metric_engine;
+extern uint16_t probe_interval;
 extern uint32_t num_hna;
-extern uint32_t pref_gateway;
+extern uint8_t *pref_gateway;
+extern uint8_t dhcp_steering;
+extern uint32_t dhcp_steered;
+extern uint32_t dhcp_offers_dropped;
+extern char *snapshot_file;
 
 extern unsigned char *hna_buff;
 
@@ -147,11 +230,23 @@ extern struct unix_client *unix_packet[256];
 
 extern uint32_t curr_time;
 
-extern struct hashtable_t *orig_hash;
+extern struct hashtable_t *orig_hash[ORIG_HASH_SHARDS];
+extern struct orig_node **orig_index;
+extern uint32_t orig_num;
+extern uint32_t orig_index_size;
+extern struct hashtable_t *forw_hash;
+extern struct hashtable_t *link_hash;
 
 extern struct list_head_first if_list;
-extern struct list_head_first gw_list;
+extern struct dlist_head gw_list;
 extern struct list_head_first forw_list;
+extern uint16_t forw_list_len;
+extern uint32_t forw_coalesced;
+extern uint32_t forw_dropped;
+extern struct pool forw_pool;
+extern struct pool orig_pool;
+extern struct pool neigh_pool;
+extern struct pool link_pool;
 extern struct vis_if vis_if;
 extern struct unix_if unix_if;
 extern struct debug_clients debug_clients;
@@ -161,40 +256,68 @@ extern char *gw2string[];
 
 struct orig_node                    /* structure for orig_list maintaining nodes of mesh */
 {
+	/* looked at for every received OGM and every forwarded payload packet - kept within the first 64 bytes */
 	uint8_t  orig[6];           /* important, must be first entry! (for faster hash comparison) */
-	struct neigh_node *router;
-	struct batman_if *batman_if;
+	uint8_t  gwflags;           /* flags related to gateway functions: gateway class */
+	uint8_t last_ttl;
 	uint32_t last_valid;        /* when last packet from this node was received */
 	uint16_t last_seqno;        /* last and best known sequence number */
+	uint16_t last_real_seqno;
+	struct neigh_node *router;
+	struct batman_if *batman_if;
+	TYPE_OF_WORD *seq_bits;            /* broadcast sequence numbers - the windows are allocated behind the structure */
+	TYPE_OF_WORD *real_bits;           /* sequence numbers received via any of the neighbours */
 	uint16_t last_bcast_seqno;  /* last broadcast sequence number received by this host */
+	struct dlist_head neigh_list;
+	struct dlist_head rank_list;   /* neighbours sorted by their ranking - the best one first */
+	struct dlist_head expiry_list; /* position within the originators ordered by last_valid */
+	uint32_t route_changed;     /* when the router was chosen (see -Y) */
+	uint16_t route_flaps;       /* number of times the router was replaced by another one */
+	uint32_t index;             /* position within orig_index */
+	struct neigh_node **if_router;  /* best neighbour per interface, indexed by if_num - allocated behind the windows (see -I) */
+	uint8_t bond_next;          /* next router in round robin bonding mode (see -B) */
+	struct gw_node *gw_node;    /* NULL unless the originator announced a gateway class */
 	int		 num_hna;
+	int16_t  hna_buff_len;
 	uint8_t *hna_buff;
 	struct  dlist_head hna_list;
-	int16_t  hna_buff_len;
-	struct list_head_first neigh_list;
-	uint8_t  gwflags;           /* flags related to gateway functions: gateway class */
-	TYPE_OF_WORD *bcast_own;
-	uint8_t *bcast_own_sum;
+};
+
+struct link_node                    /* structure for link_hash maintaining the one hop neighbours per interface */
+{
+	uint8_t  addr[6];           /* important, must be first entry! (for faster hash comparison) */
+	struct batman_if *if_incoming;  /* part of the key - the same neighbour might be heard on several interfaces */
+	uint32_t last_valid;        /* when last packet from this neighbour was received on this interface */
+	struct dlist_head expiry_list;  /* position within all links ordered by last_valid */
+	uint16_t refcount;          /* number of routes (struct neigh_node) via this link */
+	uint16_t real_packet_count;
+	uint16_t real_seqno;        /* sequence number of the neighbour real_bits is aligned to */
+	uint16_t real_seen;         /* sequence numbers of the neighbour covered by real_bits since the link came up - the window is full at local_win_size */
+	uint16_t bcast_own_sum;
+	uint16_t bcast_own_seqno;   /* own sequence number of if_incoming bcast_own is aligned to */
+	uint16_t bcast_own_seen;    /* own sequence numbers covered by bcast_own since the link came up */
 	uint8_t tq_own;
-	int tq_asym_penalty;
-	uint16_t last_real_seqno;
-	uint8_t last_ttl;
-	TYPE_OF_WORD seq_bits[NUM_WORDS];
+	uint8_t tq_asym_penalty;
+	uint32_t throughput;        /* measured by the probes of the neighbour in kbit/s - 0 if unknown (see recv_probe()) */
+	uint64_t probe_first;       /* arrival time of the first probe of the current burst in us */
+	uint8_t probe_burst;        /* burst number of the probes received last */
+	uint8_t probe_first_index;  /* index of the first probe of the current burst we received */
+	TYPE_OF_WORD *real_bits;    /* own packets of the neighbour received via this link */
+	TYPE_OF_WORD *bcast_own;    /* our packets echoed by the neighbour - both windows are allocated behind the structure (see get_link_node()) */
 };
 
-struct neigh_node
+struct neigh_node                   /* a possible router towards an originator - the link facts are shared (see struct link_node) */
 {
-	struct list_head list;
-	uint8_t addr[6];
-	uint8_t real_packet_count;
-	uint8_t tq_recv[TQ_GLOBAL_WINDOW_SIZE];
-	uint8_t tq_index;
+	struct dlist_head list;
+	struct link_node *link;
 	uint8_t tq_avg;
 	uint8_t last_ttl;         /* ttl of last received packet */
 	uint32_t last_valid;       /* when last packet via this neighbour was received */
-	TYPE_OF_WORD real_bits[NUM_WORDS];
-	struct orig_node *orig_node;
-	struct batman_if *if_incoming;
+	struct dlist_head rank_list;
+	struct orig_node *owner;        /* originator this neighbour is a possible router towards */
+	struct dlist_head expiry_list;  /* position within all neighbours ordered by last_valid */
+	uint32_t bond_packets;     /* unicast packets sent via this neighbour in bonding mode */
+	struct tq_ring tq_ring;    /* the samples are allocated behind the structure (see create_neighbor()) */
 };
 
 struct forw_node                  /* structure for forw_list maintaining packets to be send/forwarded */
@@ -202,15 +325,17 @@ struct forw_node                  /* structure for forw_list maintaining packets
 	struct list_head list;
 	uint32_t send_time;
 	uint8_t  own;
-	unsigned char *pack_buff;
+	unsigned char *pack_buff;       /* points to buff unless the packet is too big for it (see forw_node_buff()) */
 	int16_t  pack_buff_len;
 	struct batman_if *if_outgoing;
+	unsigned char buff[FORW_BUFF_INLINE];
 };
 
 struct gw_node
 {
-	struct list_head list;
-	struct orig_node *orig_node;
+	struct dlist_head list;         /* gw_list is sorted by the score - the best gateway first */
+	struct orig_node *orig_node;    /* NULL once the originator timed out */
+	uint32_t score;                 /* 0 if the gateway can't be used (see gw_node_update()) */
 	uint16_t unavail_factor;
 	uint32_t last_failure;
 	uint32_t deleted;
@@ -227,6 +352,11 @@ struct batman_if
 	pthread_t listen_thread_id;
 	struct batman_packet out;
 	struct list_head_first client_list;
+	uint16_t mtu;
+	unsigned char *aggr_buff;   /* OGMs waiting to be sent in one frame (only with aggregation) */
+	int16_t aggr_len;
+	uint32_t aggr_frames;       /* number of aggregated frames sent */
+	uint32_t aggr_ogms;         /* number of OGMs within these frames */
 };
 
 // struct gw_client
@@ -280,6 +410,7 @@ void   usage( void );
 void   verbose_usage( void );
 void update_routes( struct orig_node *orig_node, struct neigh_node *neigh_node, unsigned char *hna_recv_buff, int16_t hna_buff_len );
 void update_gw_list( struct orig_node *orig_node, uint8_t new_gwflags );
+void gw_node_update( struct gw_node *gw_node );
 int is_my_mac( uint8_t *addr );
 
 #endif
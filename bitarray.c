@@ -26,12 +26,66 @@
 
 
 
+/* mask of the bits of the last word which belong to the window */
+static TYPE_OF_WORD top_word_mask = ~((TYPE_OF_WORD)0);
+
+
+
+/* count the set bits of a single word */
+static inline int word_count( TYPE_OF_WORD word ) {
+
+#if defined(__GNUC__)
+
+	return __builtin_popcountl( word );
+
+#else
+
+	int hamming = 0;
+
+	while ( word ) {
+
+		word &= word-1;   /* see http://graphics.stanford.edu/~seander/bithacks.html#CountBitsSetKernighan */
+		hamming++;
+
+	}
+
+	return hamming;
+
+#endif
+
+}
+
+/* select the size of the sliding windows - must be called before the first window is allocated */
+void bit_set_window( uint16_t window_size ) {
+
+	int top_bits;
+
+	local_win_size = window_size;
+	local_win_words = ( window_size + WORD_BIT_SIZE - 1 ) / WORD_BIT_SIZE;
+
+	top_bits = window_size - ( local_win_words - 1 ) * WORD_BIT_SIZE;
+	top_word_mask = ( top_bits == WORD_BIT_SIZE ? ~((TYPE_OF_WORD)0) : ( ((TYPE_OF_WORD)1) << top_bits ) - 1 );
+
+}
+
+/* copy a window of old_words words into a window of the current size - the newest bits are kept */
+void bit_resize( TYPE_OF_WORD *seq_bits, TYPE_OF_WORD *old_bits, uint8_t old_words ) {
+
+	int i;
+
+	for (i = 0 ; i < local_win_words; i++)
+		seq_bits[i] = ( i < old_words ? old_bits[i] : 0 );
+
+	seq_bits[local_win_words - 1] &= top_word_mask;
+
+}
+
 /* clear the bits */
 void bit_init( TYPE_OF_WORD *seq_bits ) {
 
 	int i;
 
-	for (i = 0 ; i < (int)NUM_WORDS; i++)
+	for (i = 0 ; i < local_win_words; i++)
 		seq_bits[i]= 0;
 
 };
@@ -42,7 +96,7 @@ uint8_t get_bit_status( TYPE_OF_WORD *seq_bits, uint16_t last_seqno, uint16_t cu
 	int16_t diff, word_offset, word_num;
 
 	diff= last_seqno- curr_seqno;
-	if ( diff < 0 || diff >= TQ_LOCAL_WINDOW_SIZE ) {
+	if ( diff < 0 || diff >= local_win_size ) {
 		return 0;
 
 	} else {
@@ -50,7 +104,7 @@ uint8_t get_bit_status( TYPE_OF_WORD *seq_bits, uint16_t last_seqno, uint16_t cu
 		word_offset= ( last_seqno - curr_seqno ) % WORD_BIT_SIZE;	/* which position in the selected word */
 		word_num   = ( last_seqno - curr_seqno ) / WORD_BIT_SIZE;	/* which word */
 
-		if ( seq_bits[word_num] & 1<<word_offset )   /* get position status */
+		if ( seq_bits[word_num] & ((TYPE_OF_WORD)1)<<word_offset )   /* get position status */
 			return 1;
 		else
 			return 0;
@@ -60,23 +114,16 @@ uint8_t get_bit_status( TYPE_OF_WORD *seq_bits, uint16_t last_seqno, uint16_t cu
 }
 
 /* print the packet array, for debugging purposes */
-static char bit_string[130];
+static char bit_string[TQ_LOCAL_WINDOW_MAX + TQ_LOCAL_WINDOW_MAX / 8 + 2];
 char* bit_print( TYPE_OF_WORD *seq_bits ) {
-	int i,j,k=0,b=0;
-
-// 	printf("the last %d packets, we got %d:\n", TQ_LOCAL_WINDOW_SIZE, bit_packet_count(seq_bits));
-	for ( i=0; i<NUM_WORDS; i++ ) {
-		for ( j=0; j<WORD_BIT_SIZE; j++) {
-			bit_string[k++] = ((seq_bits[i]>>j)%2 ? '1':'0'); /* print the j position */
-			if( ++b == TQ_LOCAL_WINDOW_SIZE ) {
-				bit_string[k++]='|';
-			}
-		}
-		bit_string[k++]=' ';
+	int i,k=0;
+
+	for ( i=0; i<local_win_size; i++ ) {
+		bit_string[k++] = ((seq_bits[i / WORD_BIT_SIZE]>>(i % WORD_BIT_SIZE))%2 ? '1':'0'); /* print the i position */
+		if( ( i % WORD_BIT_SIZE ) == WORD_BIT_SIZE - 1 )
+			bit_string[k++]=' ';
 	}
 	bit_string[k++]='\0';
-//	debug_output( 4, "%s\n", bit_string);
-//	printf("\n\n");
 	return bit_string;
 }
 
@@ -84,17 +131,14 @@ char* bit_print( TYPE_OF_WORD *seq_bits ) {
 void bit_mark( TYPE_OF_WORD *seq_bits, int32_t n ) {
 	int32_t word_offset,word_num;
 
-	if ( n<0 || n >= TQ_LOCAL_WINDOW_SIZE ) {			/* if too old, just drop it */
-// 		printf("got old packet, dropping\n");
+	if ( n<0 || n >= local_win_size ) {			/* if too old, just drop it */
 		return;
 	}
 
-// 	printf("mark bit %d\n", n);
-
 	word_offset= n%WORD_BIT_SIZE;	/* which position in the selected word */
 	word_num   = n/WORD_BIT_SIZE;	/* which word */
 
-	seq_bits[word_num]|= 1<<word_offset;	/* turn the position on */
+	seq_bits[word_num]|= ((TYPE_OF_WORD)1)<<word_offset;	/* turn the position on */
 }
 
 /* shift the packet array p by n places. */
@@ -102,13 +146,24 @@ void bit_shift( TYPE_OF_WORD *seq_bits, int32_t n ) {
 	int32_t word_offset, word_num;
 	int32_t i;
 
-//	bit_print( seq_bits );
 	if( n<=0 ) return;
 
+	/* everything is shifted out of the window */
+	if ( n >= local_win_size ) {
+		bit_init( seq_bits );
+		return;
+	}
+
+	/* the whole window fits into one word (the default on 64 bit machines) */
+	if ( local_win_words == 1 ) {
+		seq_bits[0] = ( seq_bits[0] << n ) & top_word_mask;
+		return;
+	}
+
 	word_offset= n%WORD_BIT_SIZE;	/* shift how much inside each word */
 	word_num   = n/WORD_BIT_SIZE;	/* shift over how much (full) words */
 
-	for ( i=NUM_WORDS-1; i>word_num; i-- ) {
+	for ( i=local_win_words-1; i>word_num; i-- ) {
 		/* going from old to new, so we can't overwrite the data we copy from. *
  		 * left is high, right is low: FEDC BA98 7654 3210
 		 *	                                  ^^ ^^
@@ -119,10 +174,11 @@ void bit_shift( TYPE_OF_WORD *seq_bits, int32_t n ) {
 		 * our desired output would be: 9876 5432 1000 0000
 		 * */
 
+		/* a shift by the full word size is undefined, the lower word does not contribute then */
 		seq_bits[i]=
-			(seq_bits[i - word_num] << word_offset) +
+			(seq_bits[i - word_num] << word_offset) |
 					/* take the lower port from the left half, shift it left to its final position */
-			(seq_bits[i - word_num - 1] >>	(WORD_BIT_SIZE-word_offset));
+			(word_offset ? (seq_bits[i - word_num - 1] >> (WORD_BIT_SIZE-word_offset)) : 0);
 					/* and the upper part of the right half and shift it left to it's position */
 		/* for our example that would be: word[0] = 9800 + 0076 = 9876 */
 	}
@@ -137,16 +193,16 @@ void bit_shift( TYPE_OF_WORD *seq_bits, int32_t n ) {
 	for (; i>=0; i--) {
 		seq_bits[i]= 0;
 	}
-//	bit_print( seq_bits );
+
+	/* drop what was shifted beyond the end of the window */
+	seq_bits[local_win_words - 1] &= top_word_mask;
 }
 
 
 /* receive and process one packet, returns 1 if received seq_num is considered new, 0 if old  */
 char bit_get_packet( TYPE_OF_WORD *seq_bits, int16_t seq_num_diff, int8_t set_mark ) {
 
-	int i;
-
-	if ( ( seq_num_diff < 0 ) && ( seq_num_diff >= -TQ_LOCAL_WINDOW_SIZE ) ) {  /* we already got a sequence number higher than this one, so we just mark it. this should wrap around the integer just fine */
+	if ( ( seq_num_diff < 0 ) && ( seq_num_diff >= -local_win_size ) ) {  /* we already got a sequence number higher than this one, so we just mark it. this should wrap around the integer just fine */
 
 		if ( set_mark )
 			bit_mark( seq_bits, -seq_num_diff );
@@ -155,16 +211,15 @@ char bit_get_packet( TYPE_OF_WORD *seq_bits, int16_t seq_num_diff, int8_t set_ma
 
 	}
 
-	if ( ( seq_num_diff > TQ_LOCAL_WINDOW_SIZE ) || ( seq_num_diff < -TQ_LOCAL_WINDOW_SIZE ) ) {        /* it seems we missed a lot of packets or the other host restarted */
+	if ( ( seq_num_diff > local_win_size ) || ( seq_num_diff < -local_win_size ) ) {        /* it seems we missed a lot of packets or the other host restarted */
 
-		 if ( seq_num_diff > TQ_LOCAL_WINDOW_SIZE )
+		 if ( seq_num_diff > local_win_size )
 			debug_output( 4, "It seems we missed a lot of packets (%i) !\n",  seq_num_diff-1 );
 
-		if ( -seq_num_diff > TQ_LOCAL_WINDOW_SIZE )
+		if ( -seq_num_diff > local_win_size )
 			debug_output( 4, "Other host probably restarted !\n" );
 
-		for (i=0; i<NUM_WORDS; i++)
-			seq_bits[i]= 0;
+		bit_init( seq_bits );
 
 		if ( set_mark )
 			seq_bits[0] = 1;  /* we only have the latest packet */
@@ -185,21 +240,15 @@ char bit_get_packet( TYPE_OF_WORD *seq_bits, int16_t seq_num_diff, int8_t set_ma
 /* count the hamming weight, how many good packets did we receive? just count the 1's ... */
 int bit_packet_count( TYPE_OF_WORD *seq_bits ) {
 
-	int i, hamming = 0;
-	TYPE_OF_WORD word;
-
-	for (i=0; i<NUM_WORDS; i++) {
+	int i, hamming;
 
-		word = seq_bits[i];
+	if ( local_win_words == 1 )
+		return word_count( seq_bits[0] );
 
-		while (word) {
+	hamming = 0;
 
-			word &= word-1;   /* see http://graphics.stanford.edu/~seander/bithacks.html#CountBitsSetKernighan */
-			hamming++;
-
-		}
-
-	}
+	for (i=0; i<local_win_words; i++)
+		hamming += word_count( seq_bits[i] );
 
 	return(hamming);
 
@@ -207,16 +256,6 @@ int bit_packet_count( TYPE_OF_WORD *seq_bits ) {
 
 uint8_t bit_count( int32_t to_count ) {
 
-	uint8_t hamming = 0;
-
-	while ( to_count ) {
-
-		to_count &= to_count-1;   /* see http://graphics.stanford.edu/~seander/bithacks.html#CountBitsSetKernighan */
-		hamming++;
-
-	}
-
-	return(hamming);
+	return word_count( (uint32_t)to_count );
 
 }
-
@@ -25,7 +25,9 @@
 
 
 
+void bit_set_window( uint16_t window_size );
 void bit_init( TYPE_OF_WORD *seq_bits );
+void bit_resize( TYPE_OF_WORD *seq_bits, TYPE_OF_WORD *old_bits, uint8_t old_words );
 uint8_t get_bit_status( TYPE_OF_WORD *seq_bits, uint16_t last_seqno, uint16_t curr_seqno );
 char *bit_print( TYPE_OF_WORD *seq_bits );
 void bit_mark( TYPE_OF_WORD *seq_bits, int32_t n );
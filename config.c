@@ -0,0 +1,293 @@
+/* Copyright (C) 2008 B.A.T.M.A.N. contributors:
+ * Marek Lindner
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ *
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include "config.h"
+#include "originator.h"
+#include "bitarray.h"
+#include "metric.h"
+#include "os.h"
+
+
+
+/* a protocol parameter which can be set with -O at startup or via the unix socket at runtime */
+struct config_param {
+	char *name;
+	void *value;
+	uint8_t size;             /* of the variable in bytes */
+	uint32_t min;
+	uint32_t max;
+	char *(*check)( uint32_t value );                  /* returns why the value can't be used or NULL */
+	void (*apply)( uint32_t old_value, uint8_t live ); /* called once the variable holds the new value */
+	uint8_t pending;          /* set by the unix socket thread - the main loop applies it (see config_apply_pending()) */
+	uint32_t pending_value;
+};
+
+
+
+static pthread_mutex_t config_mutex = PTHREAD_MUTEX_INITIALIZER;
+static volatile uint8_t config_pending = 0;   /* at least one parameter waits for the main loop */
+
+
+
+static char *jitter_check( uint32_t value ) {
+
+	if ( (int32_t)value >= originator_interval )
+		return "has to be smaller than the originator interval (see -o)";
+
+	return NULL;
+
+}
+
+/* the fisheye hop count is derived from the ttl of the received OGMs - all nodes have to use the same one with -f */
+static char *ttl_check( uint32_t value ) {
+
+	if ( value < fisheye_radius )
+		return "must not be smaller than the fisheye radius (see -f)";
+
+	return NULL;
+
+}
+
+static char *purge_timeout_check( uint32_t value ) {
+
+	/* ORIG_INTERVAL_LIMIT, ROUTE_HOLD_TIME_MAX and PROBE_INTERVAL_MAX depend on it - capped like them by the size of the variables */
+	uint32_t limit = ( value / 10 < UINT16_MAX ? value / 10 : UINT16_MAX );
+
+	if ( ( ( limit < INT16_MAX ? limit : INT16_MAX ) < (uint32_t)originator_interval_max ) || ( limit < route_hold_time ) || ( limit < probe_interval ) )
+		return "has to be 10 times the maximal originator interval, the route hold time and the probe interval at least (see -A, -Y and -P)";
+
+	return NULL;
+
+}
+
+static void ttl_apply( uint32_t BATUNUSED(old_value), uint8_t live ) {
+
+	struct list_head *if_pos;
+
+	/* the interfaces are not set up yet otherwise */
+	if ( !live )
+		return;
+
+	list_for_each( if_pos, &if_list )
+		list_entry( if_pos, struct batman_if, list )->out.ttl = ttl;
+
+}
+
+static void hop_penalty_apply( uint32_t BATUNUSED(old_value), uint8_t live ) {
+
+	if ( live )
+		metric_init( metric_engine );
+
+}
+
+static void local_win_apply( uint32_t BATUNUSED(old_value), uint8_t live ) {
+
+	uint8_t old_words = local_win_words;
+
+	bit_set_window( local_win_size );
+
+	if ( !live )
+		return;
+
+	orig_resize_local_win( old_words );
+	metric_init( metric_engine );
+
+}
+
+static void global_win_apply( uint32_t old_value, uint8_t live ) {
+
+	/* the EWMA mode does not keep any samples */
+	if ( ( live ) && ( !tq_ewma_shift ) )
+		orig_resize_global_win( old_value );
+
+}
+
+
+
+static struct config_param config_params[] = {
+	{ "jitter", &jitter, sizeof(jitter), 0, 10000, jitter_check, NULL, 0, 0 },
+	{ "ttl", &ttl, sizeof(ttl), 1, 255, ttl_check, ttl_apply, 0, 0 },
+	{ "purge_timeout", &purge_timeout, sizeof(purge_timeout), PURGE_TIMEOUT_MIN, PURGE_TIMEOUT_MAX, purge_timeout_check, NULL, 0, 0 },
+	{ "hop_penalty", &hop_penalty, sizeof(hop_penalty), 0, TQ_MAX_VALUE, NULL, hop_penalty_apply, 0, 0 },
+	{ "local_window", &local_win_size, sizeof(local_win_size), TQ_LOCAL_WINDOW_MIN, TQ_LOCAL_WINDOW_MAX, NULL, local_win_apply, 0, 0 },
+	{ "global_window", &global_win_size, sizeof(global_win_size), 1, TQ_GLOBAL_WINDOW_MAX, NULL, global_win_apply, 0, 0 },
+	{ "packets_per_cycle", &packets_per_cycle, sizeof(packets_per_cycle), 1, 1000, NULL, NULL, 0, 0 },
+	{ "age_threshold", &age_threshold, sizeof(age_threshold), 10000, 86400000, NULL, NULL, 0, 0 },
+	{ "broadcast_unknown_dest", &bcast_unknown_dest, sizeof(bcast_unknown_dest), 0, 1, NULL, NULL, 0, 0 },
+	{ NULL, NULL, 0, 0, 0, NULL, NULL, 0, 0 }
+};
+
+
+
+static uint32_t config_get( struct config_param *param ) {
+
+	if ( param->size == 1 )
+		return *(uint8_t *)param->value;
+
+	if ( param->size == 2 )
+		return *(uint16_t *)param->value;
+
+	return *(uint32_t *)param->value;
+
+}
+
+static void config_put( struct config_param *param, uint32_t value, uint8_t live ) {
+
+	uint32_t old_value = config_get( param );
+
+	if ( param->size == 1 )
+		*(uint8_t *)param->value = value;
+	else if ( param->size == 2 )
+		*(uint16_t *)param->value = value;
+	else
+		*(uint32_t *)param->value = value;
+
+	if ( param->apply != NULL )
+		param->apply( old_value, live );
+
+}
+
+
+
+/* setting is "name=value" - at runtime (live) the new value is only checked here and
+ * applied by the main loop later as the unix socket has its own thread,
+ * msg_buff receives the confirmation or the reason why the setting was refused */
+int config_set( char *setting, char *msg_buff, int msg_len, uint8_t live ) {
+
+	struct config_param *param;
+	char *value_ptr, *end_ptr, *reason;
+	unsigned long value;
+
+	if ( ( value_ptr = strchr( setting, '=' ) ) == NULL ) {
+
+		snprintf( msg_buff, msg_len, "Error - setting has to be given as name=value: %s\n", setting );
+		return 0;
+
+	}
+
+	for ( param = config_params; param->name != NULL; param++ ) {
+
+		if ( ( strlen( param->name ) == (size_t)( value_ptr - setting ) ) && ( strncmp( param->name, setting, value_ptr - setting ) == 0 ) )
+			break;
+
+	}
+
+	if ( param->name == NULL ) {
+
+		snprintf( msg_buff, msg_len, "Error - unknown parameter: %.*s\n", (int)( value_ptr - setting ), setting );
+		return 0;
+
+	}
+
+	value_ptr++;
+	value = strtoul( value_ptr, &end_ptr, 10 );
+
+	if ( ( *value_ptr == '\0' ) || ( *end_ptr != '\0' ) || ( value < param->min ) || ( value > param->max ) ) {
+
+		snprintf( msg_buff, msg_len, "Error - invalid value for %s: %s (allowed values: %u - %u)\n", param->name, value_ptr, param->min, param->max );
+		return 0;
+
+	}
+
+	if ( ( param->check != NULL ) && ( ( reason = param->check( value ) ) != NULL ) ) {
+
+		snprintf( msg_buff, msg_len, "Error - invalid value for %s: %lu %s\n", param->name, value, reason );
+		return 0;
+
+	}
+
+	if ( !live ) {
+
+		config_put( param, value, 0 );
+		snprintf( msg_buff, msg_len, "%s: %lu\n", param->name, value );
+		return 1;
+
+	}
+
+	if ( pthread_mutex_lock( &config_mutex ) != 0 )
+		debug_output( 0, "Error - could not lock config mutex (config_set): %s \n", strerror( errno ) );
+
+	param->pending = 1;
+	param->pending_value = value;
+	config_pending = 1;
+
+	if ( pthread_mutex_unlock( &config_mutex ) != 0 )
+		debug_output( 0, "Error - could not unlock config mutex (config_set): %s \n", strerror( errno ) );
+
+	snprintf( msg_buff, msg_len, "%s set to %lu\n", param->name, value );
+	return 1;
+
+}
+
+
+
+/* called by the main loop - the originators and their windows are only touched by it */
+void config_apply_pending( void ) {
+
+	struct config_param *param;
+
+	if ( !config_pending )
+		return;
+
+	if ( pthread_mutex_lock( &config_mutex ) != 0 )
+		debug_output( 0, "Error - could not lock config mutex (config_apply_pending): %s \n", strerror( errno ) );
+
+	config_pending = 0;
+
+	for ( param = config_params; param->name != NULL; param++ ) {
+
+		if ( !param->pending )
+			continue;
+
+		param->pending = 0;
+
+		if ( config_get( param ) == param->pending_value )
+			continue;
+
+		debug_output( 3, "Changing %s from %u to %u \n", param->name, config_get( param ), param->pending_value );
+		config_put( param, param->pending_value, 1 );
+
+	}
+
+	if ( pthread_mutex_unlock( &config_mutex ) != 0 )
+		debug_output( 0, "Error - could not unlock config mutex (config_apply_pending): %s \n", strerror( errno ) );
+
+}
+
+
+
+/* one line per parameter: name, current value and the allowed range - returns the length */
+int config_print( char *buff, int len ) {
+
+	struct config_param *param;
+	int written = 0;
+
+	for ( param = config_params; ( param->name != NULL ) && ( written < len ); param++ )
+		written += snprintf( buff + written, len - written, "%-24s %10u   (%u - %u)\n", param->name, config_get( param ), param->min, param->max );
+
+	return ( written < len ? written : len - 1 );
+
+}
@@ -0,0 +1,38 @@
+/* Copyright (C) 2008 B.A.T.M.A.N. contributors:
+ * Marek Lindner
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ *
+ */
+
+
+
+#ifndef _BATMAN_CONFIG_H
+#define _BATMAN_CONFIG_H
+
+#include <stdint.h>
+#include "batman-adv.h"
+
+
+
+#define CONFIG_ARGS_MAX 16   /* -O options accepted on the command line */
+
+
+
+int config_set( char *setting, char *msg_buff, int msg_len, uint8_t live );
+void config_apply_pending( void );
+int config_print( char *buff, int len );
+
+#endif
@@ -22,9 +22,16 @@
 
 #include <stdio.h>		/* NULL */
 #include "hash.h"
+#include "pool.h"
 #include "allocate.h"
 
 
+
+/* the buckets of all hashes share one pool - it is set up with the first hash and released with the last one */
+static struct pool element_pool;
+static int hashes_num = 0;
+
+
 /* clears the hash */
 void hash_init(struct hashtable_t *hash) {
 	int i;
@@ -52,7 +59,7 @@ void hash_delete(struct hashtable_t *hash, hashdata_free_cb free_cb) {
 
 			last_bucket= bucket;
 			bucket= bucket->next;
-			debugFree(last_bucket, 1301);
+			pool_free(&element_pool, last_bucket);
 
 		}
 
@@ -68,6 +75,9 @@ void hash_destroy(struct hashtable_t *hash) {
 	debugFree( hash->table, 1302 );
 	debugFree( hash, 1303 );
 
+	if ( --hashes_num == 0 )
+		pool_destroy( &element_pool );
+
 }
 
 
@@ -161,6 +171,10 @@ struct hashtable_t *hash_new(int size, hashdata_compare_cb compare, hashdata_cho
 	hash_init(hash);
 	hash->compare= compare;
 	hash->choose= choose;
+
+	if ( hashes_num++ == 0 )
+		pool_init( &element_pool, "hash bucket", sizeof(struct element_t), 256, 304 );
+
 	return(hash);
 }
 
@@ -182,8 +196,7 @@ int hash_add(struct hashtable_t *hash, void *data) {
 	}
 
 	/* found the tail of the list, add new element */
-	if (NULL == (bucket= debugMalloc(sizeof(struct element_t),304)))
-		return(-1); /* debugMalloc failed */
+	bucket= pool_alloc(&element_pool);
 
 	bucket->data= data;				/* init the new bucket */
 	bucket->next= NULL;
@@ -232,7 +245,7 @@ void *hash_remove_bucket(struct hashtable_t *hash, struct hash_it_t *hash_it_t)
 		(*hash_it_t->first_bucket) = hash_it_t->bucket->next;
 	}
 
-	debugFree(hash_it_t->bucket, 1306);
+	pool_free(&element_pool, hash_it_t->bucket);
 
 	hash->elements--;
 	return( data_save );
@@ -291,6 +304,12 @@ struct hashtable_t *hash_resize(struct hashtable_t *hash, int size) {
 }
 
 
+/* print the usage of the bucket pool (see pool_debug()) */
+void hash_pool_debug(void) {
+	pool_debug(&element_pool);
+}
+
+
 /* print the hash table for debugging */
 void hash_debug(struct hashtable_t *hash) {
 	int i;
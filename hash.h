@@ -88,6 +88,9 @@ struct hashtable_t	*hash_resize(struct hashtable_t *hash, int size);
 /* print the hash table for debugging */
 void 				 hash_debug( struct hashtable_t *hash);
 
+/* print the usage of the buckets shared by all hashes */
+void 				 hash_pool_debug(void);
+
 /* iterate though the hash. first element is selected with iter_in NULL.
  * use the returned iterator to access the elements until hash_it_t returns NULL. */
 struct hash_it_t 	*hash_iterate(struct hashtable_t *hash, struct hash_it_t *iter_in);
@@ -23,6 +23,8 @@
 #include <string.h>             /* strncpy() */
 #include <unistd.h>             /* close() */
 #include <sys/ioctl.h>          /* ioctl(), SIO* */
+#include <sys/time.h>           /* gettimeofday() */
+#include <linux/sockios.h>      /* SIOCGSTAMP */
 #include <arpa/inet.h>          /* htons() */
 #include <sys/uio.h>            /* writev(), readv() */
 #include <sys/types.h>          /* socket(), bind() */
@@ -115,6 +117,21 @@ int32_t rawsock_read(int32_t rawsock, struct ether_header *recv_header, unsigned
 
 
 
+/* receive time of the last packet read from the raw socket in microseconds -
+ * taken by the kernel, so it does not depend on when we got around to read the packet */
+uint64_t rawsock_timestamp( int32_t rawsock ) {
+
+	struct timeval tv;
+
+	if ( ioctl( rawsock, SIOCGSTAMP, &tv ) < 0 )
+		gettimeofday( &tv, NULL );
+
+	return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+
+}
+
+
+
 /* write size bytes of input, and the header. returns 0 on success, < 0 on error.*/
 int32_t rawsock_write(int32_t rawsock, struct ether_header *send_header, unsigned char *buf, int16_t size) {
 	struct iovec vector[2];
@@ -168,8 +185,8 @@ int32_t rawsock_write(int32_t rawsock, struct ether_header *send_header, unsigne
 
 	}*/
 
-	/* Try sending PACKETS_PER_CYCLE times to send the packet, and drop it otherwise. */
-	for (i=0; i< PACKETS_PER_CYCLE; i++) {
+	/* Try sending packets_per_cycle times to send the packet, and drop it otherwise. */
+	for (i=0; i< packets_per_cycle; i++) {
 		if ( ( ret = writev(rawsock, vector, 2) ) < 0 ) {
 			if (errno == EAGAIN || errno == ESPIPE){
 				debug_output( 4, "Error - can't write to raw socket: %s , but we retry\n", strerror(errno) );
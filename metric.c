@@ -0,0 +1,174 @@
+/* Copyright (C) 2008 B.A.T.M.A.N. contributors:
+ * Marek Lindner
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ *
+ */
+
+
+
+#include "metric.h"
+#include "probe.h"
+
+
+
+/* the tq math is table driven - the tables depend on the window size and are filled by metric_init() */
+static uint8_t asym_penalty_table[TQ_LOCAL_WINDOW_MAX + 1];  /* indexed by the number of received packets */
+static uint32_t recv_recip_table[TQ_LOCAL_WINDOW_MAX + 1];   /* TQ_MAX_VALUE / received packets in 16.16 fixed point, rounded up */
+static uint8_t hop_penalty_table[TQ_MAX_VALUE + 1];
+
+struct metric_ops *metric = NULL;
+
+
+
+/* x / TQ_MAX_VALUE without division, exact for every product of two tq values */
+#define TQ_DIV(x) ( ( (x) + 1 + ( (x) >> 8 ) ) >> 8 )
+
+
+
+static uint8_t tq_link_quality( struct link_node *link_node, uint16_t echo_count ) {
+
+	uint16_t real_count = link_node->real_packet_count, asym_count = link_node->real_packet_count;
+
+	/* if we have too few packets (too less data) we set tq_own to zero */
+	/* if we receive too few packets it is not considered bidirectional */
+	if ( ( echo_count < TQ_LOCAL_BIDRECT_SEND_MINIMUM ) || ( real_count < TQ_LOCAL_BIDRECT_RECV_MINIMUM ) ) {
+
+		link_node->tq_own = 0;
+		link_node->tq_asym_penalty = asym_penalty_table[real_count];
+		return 0;
+
+	}
+
+	/* the windows of a new link are not full yet - the counts are extrapolated to the whole window (the two sides
+	 * might send at a different rate while bootstrapping), the asymmetry with one assumed loss so that a single
+	 * packet counts as half the window instead of penalizing the link until the window filled */
+	if ( ( link_node->real_seen > 0 ) && ( link_node->real_seen < local_win_size ) ) {
+
+		real_count = ( link_node->real_packet_count * local_win_size ) / link_node->real_seen;
+		asym_count = ( link_node->real_packet_count * local_win_size ) / ( link_node->real_seen + 1 );
+
+	}
+
+	if ( ( link_node->bcast_own_seen > 0 ) && ( link_node->bcast_own_seen < local_win_size ) )
+		echo_count = ( echo_count * local_win_size ) / link_node->bcast_own_seen;
+
+	/* a late packet marked right after a reset counts more than it covers - the tables end with the window */
+	if ( real_count > local_win_size )
+		real_count = local_win_size;
+
+	if ( asym_count > local_win_size )
+		asym_count = local_win_size;
+
+	if ( echo_count > local_win_size )
+		echo_count = local_win_size;
+
+	/* pay attention to not get a value bigger than 100 % */
+	if ( echo_count > real_count )
+		echo_count = real_count;
+
+	/* rounding the reciprocal up keeps the result exact (TQ_MAX_VALUE * echo_count / real_packet_count) */
+	link_node->tq_own = ( echo_count * recv_recip_table[real_count] ) >> 16;
+	link_node->tq_asym_penalty = asym_penalty_table[asym_count];
+
+	return TQ_DIV( link_node->tq_own * link_node->tq_asym_penalty );
+
+}
+
+
+
+static uint8_t tq_combine( uint8_t path, uint8_t link ) {
+
+	return TQ_DIV( path * link );
+
+}
+
+
+
+static uint8_t tq_hop_penalty( uint8_t path ) {
+
+	return hop_penalty_table[path];
+
+}
+
+
+
+static int tq_compare( uint8_t value, uint8_t other ) {
+
+	return value - other;
+
+}
+
+
+
+/* the link still has to be bidirectional but its throughput limits the path (see probe_encode()) */
+static uint8_t throughput_link_quality( struct link_node *link_node, uint16_t echo_count ) {
+
+	if ( tq_link_quality( link_node, echo_count ) < TQ_TOTAL_BIDRECT_LIMIT )
+		return 0;
+
+	return probe_link_metric( link_node );
+
+}
+
+
+
+static uint8_t throughput_combine( uint8_t path, uint8_t link ) {
+
+	return ( link < path ? link : path );
+
+}
+
+
+
+static uint8_t throughput_hop_penalty( uint8_t path ) {
+
+	return ( path > THROUGHPUT_HOP_PENALTY ? path - THROUGHPUT_HOP_PENALTY : 0 );
+
+}
+
+
+
+static struct metric_ops metric_tq = { "transmit quality", tq_link_quality, tq_combine, tq_hop_penalty, tq_compare };
+static struct metric_ops metric_throughput = { "throughput", throughput_link_quality, throughput_combine, throughput_hop_penalty, tq_compare };
+
+
+
+/* must be called once the window size is known */
+void metric_init( uint8_t engine ) {
+
+	uint16_t i, missed;
+
+	for ( i = 0; i <= local_win_size; i++ ) {
+
+		missed = local_win_size - i;
+
+		/* 1 - ((1-x)** 3), normalized to TQ_MAX_VALUE */
+		/* this does affect the nearly-symmetric links only a little,
+		* but punishes asymetric links more. */
+		/* calculated in 64 bit as the cube of the bigger windows does not fit into 32 bit */
+		asym_penalty_table[i] = TQ_MAX_VALUE - (int)( ( TQ_MAX_VALUE * (uint64_t)missed * missed * missed ) /
+				( (uint64_t)local_win_size * local_win_size * local_win_size ) );
+
+		recv_recip_table[i] = ( i == 0 ? 0 : ( ( TQ_MAX_VALUE << 16 ) + i - 1 ) / i );
+
+	}
+
+	for ( i = 0; i <= TQ_MAX_VALUE; i++ )
+		hop_penalty_table[i] = ( i * ( TQ_MAX_VALUE - hop_penalty ) ) / TQ_MAX_VALUE;
+
+	metric = ( engine == METRIC_THROUGHPUT ? &metric_throughput : &metric_tq );
+
+}
@@ -0,0 +1,46 @@
+/* Copyright (C) 2008 B.A.T.M.A.N. contributors:
+ * Marek Lindner
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ *
+ */
+
+
+
+#ifndef _BATMAN_METRIC_H
+#define _BATMAN_METRIC_H
+
+#include <stdint.h>
+#include "batman-adv.h"
+
+
+
+/* everything the routing decisions depend on - the OGM handling only calls these hooks (see -m) */
+struct metric_ops
+{
+	char *name;
+	uint8_t (*link_quality)( struct link_node *link_node, uint16_t echo_count );  /* value of the link towards a neighbour, updates tq_own and tq_asym_penalty */
+	uint8_t (*combine)( uint8_t path, uint8_t link );  /* value of the path via this link */
+	uint8_t (*hop_penalty)( uint8_t path );            /* value forwarded to the next hop */
+	int (*compare)( uint8_t value, uint8_t other );    /* > 0 if value is better than other, the result is compared with -y */
+};
+
+
+
+extern struct metric_ops *metric;
+
+void metric_init( uint8_t engine );
+
+#endif
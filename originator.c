@@ -23,30 +23,240 @@
 #include <stdlib.h>
 #include "os.h"
 #include "batman-adv.h"
+#include "originator.h"
 #include "ring_buffer.h"
+#include "schedule.h"
+#include "metric.h"
 
 
 
-struct neigh_node * create_neighbor(struct orig_node *orig_node, struct orig_node *orig_neigh_node, uint8_t *neigh, struct batman_if *if_incoming) {
+/* originators, neighbours and links ordered by last_valid - the ones which time out first at the head */
+static DLIST_HEAD(orig_expiry_list);
+static DLIST_HEAD(neigh_expiry_list);
+static DLIST_HEAD(link_expiry_list);
+
+
+
+struct neigh_node * create_neighbor(struct orig_node *orig_node, struct link_node *link_node) {
 
 	struct neigh_node *neigh_node;
 
 	debug_output( 4, "Creating new last-hop neighbour of originator\n" );
 
-	neigh_node = debugMalloc( sizeof(struct neigh_node), 403 );
-	memset( neigh_node, 0, sizeof(struct neigh_node) );
-	INIT_LIST_HEAD(&neigh_node->list);
+	neigh_node = pool_alloc( &neigh_pool );
+	memset( neigh_node, 0, neigh_pool.obj_size );
 
-	memcpy(neigh_node->addr, neigh, 6);
-	neigh_node->orig_node = orig_neigh_node;
-	neigh_node->if_incoming = if_incoming;
+	ring_buffer_init(&neigh_node->tq_ring, (uint8_t *)(neigh_node + 1));
 
-	list_add_tail(&neigh_node->list, &orig_node->neigh_list);
+	neigh_node->link = link_node;
+	neigh_node->owner = orig_node;
+	link_node->refcount++;
+
+	dlist_add_tail(&neigh_node->list, &orig_node->neigh_list);
+	dlist_add_tail(&neigh_node->rank_list, &orig_node->rank_list);
+
+	/* not valid yet - it times out first */
+	dlist_add(&neigh_node->expiry_list, &neigh_expiry_list);
 
 	return neigh_node;
 
 }
 
+/* the time is monotonic - moving the refreshed entries to the tail keeps the expiry lists ordered */
+void neigh_node_refresh(struct neigh_node *neigh_node, uint32_t curr_time)
+{
+	neigh_node->last_valid = curr_time;
+	dlist_move_tail(&neigh_node->expiry_list, &neigh_expiry_list);
+}
+
+void orig_node_refresh(struct orig_node *orig_node, uint32_t curr_time)
+{
+	orig_node->last_valid = curr_time;
+	dlist_move_tail(&orig_node->expiry_list, &orig_expiry_list);
+}
+
+void link_node_refresh(struct link_node *link_node, uint32_t curr_time)
+{
+	link_node->last_valid = curr_time;
+	dlist_move_tail(&link_node->expiry_list, &link_expiry_list);
+}
+
+
+
+/* needed for hash, compares 2 struct link_node by mac address and interface */
+int32_t compare_link( void *data1, void *data2 ) {
+
+	if ( ((struct link_node *)data1)->if_incoming != ((struct link_node *)data2)->if_incoming )
+		return 1;
+
+	return ( memcmp( data1, data2, 6 ) );
+
+}
+
+
+
+int32_t choose_link( void *data, int32_t size ) {
+
+	return ( choose_orig( data, size ) + ((struct link_node *)data)->if_incoming->if_num ) % size;
+
+}
+
+
+
+/* this function finds the link towards the given neighbour via the given interface */
+struct link_node *find_link_node( uint8_t *neigh, struct batman_if *if_incoming ) {
+
+	struct link_node link_key;
+
+	memcpy( link_key.addr, neigh, 6 );
+	link_key.if_incoming = if_incoming;
+
+	return hash_find( link_hash, &link_key );
+
+}
+
+
+
+/* this function finds or creates the link towards the given neighbour via the given interface */
+struct link_node *get_link_node( uint8_t *neigh, struct batman_if *if_incoming ) {
+
+	struct hashtable_t *swaphash;
+	struct link_node *link_node;
+
+	if ( NULL != ( link_node = find_link_node( neigh, if_incoming ) ) )
+		return link_node;
+
+	debug_output(4, "Creating new link: %s via %s \n", addr_to_string_static(neigh), if_incoming->dev);
+
+	link_node = pool_alloc( &link_pool );
+	memset( link_node, 0, link_pool.obj_size );
+
+	link_node->real_bits = (TYPE_OF_WORD *)(link_node + 1);
+	link_node->bcast_own = link_node->real_bits + local_win_words;
+
+	memcpy( link_node->addr, neigh, 6 );
+	link_node->if_incoming = if_incoming;
+	link_node->bcast_own_seqno = if_incoming->out.seqno;
+	link_node->bcast_own_seen = 1;   /* our last packet might be echoed already */
+
+	/* not valid yet - it times out first */
+	dlist_add( &link_node->expiry_list, &link_expiry_list );
+
+	hash_add( link_hash, link_node );
+
+	if ( link_hash->elements * 4 > link_hash->size ) {
+
+		swaphash = hash_resize( link_hash, link_hash->size * 2 );
+
+		if ( swaphash == NULL ) {
+
+			debug_output( 0, "Couldn't resize hash table \n" );
+			restore_and_exit(0);
+
+		}
+
+		link_hash = swaphash;
+
+	}
+
+	/* a new one hop neighbour */
+	orig_interval_reset();
+	bootstrap_start();
+
+	return link_node;
+
+}
+
+
+
+/* the real_bits window of a link is only shifted when it is read or updated -
+ * this aligns it to the latest sequence number of the neighbour */
+void link_sync_real_bits(struct orig_node *orig_neigh_node, struct link_node *link_node)
+{
+	int16_t seq_diff = orig_neigh_node->last_real_seqno - link_node->real_seqno;
+
+	if (seq_diff == 0)
+		return;
+
+	/* the neighbour restarted, we have not heard of it for a whole window or the link is new */
+	if ((seq_diff < 0) || (seq_diff >= local_win_size) || (link_node->real_seen == 0)) {
+
+		bit_init(link_node->real_bits);
+		link_node->real_packet_count = 0;
+		link_node->real_seen = 1;
+
+	} else {
+
+		bit_shift(link_node->real_bits, seq_diff);
+		link_node->real_packet_count = bit_packet_count(link_node->real_bits);
+		link_node->real_seen = (link_node->real_seen + seq_diff < local_win_size ? link_node->real_seen + seq_diff : local_win_size);
+
+	}
+
+	link_node->real_seqno = orig_neigh_node->last_real_seqno;
+}
+
+/* remember that the given sequence number of the neighbour was received via this link */
+void link_mark_real_bit(struct orig_node *orig_neigh_node, struct link_node *link_node, uint16_t seqno)
+{
+	int16_t seq_offset;
+
+	link_sync_real_bits(orig_neigh_node, link_node);
+
+	seq_offset = orig_neigh_node->last_real_seqno - seqno;
+
+	/* too old or already marked */
+	if ((seq_offset < 0) || (seq_offset >= local_win_size))
+		return;
+
+	if (get_bit_status(link_node->real_bits, orig_neigh_node->last_real_seqno, seqno))
+		return;
+
+	bit_mark(link_node->real_bits, seq_offset);
+	link_node->real_packet_count++;
+}
+
+/* the own broadcast window of a link is not shifted whenever we schedule one of
+ * our packets but only when it is used - this catches up with the packets sent
+ * on the interface of the link since and returns the number of echos within the window */
+uint16_t bcast_own_sync(struct link_node *link_node)
+{
+	uint16_t seq_diff = link_node->if_incoming->out.seqno - link_node->bcast_own_seqno;
+
+	if (seq_diff == 0)
+		return link_node->bcast_own_sum;
+
+	if (seq_diff >= local_win_size) {
+
+		bit_init(link_node->bcast_own);
+		link_node->bcast_own_sum = 0;
+		link_node->bcast_own_seen = local_win_size;
+
+	} else {
+
+		bit_shift(link_node->bcast_own, seq_diff);
+		link_node->bcast_own_sum = bit_packet_count(link_node->bcast_own);
+		link_node->bcast_own_seen = (link_node->bcast_own_seen + seq_diff < local_win_size ? link_node->bcast_own_seen + seq_diff : local_win_size);
+
+	}
+
+	link_node->bcast_own_seqno = link_node->if_incoming->out.seqno;
+
+	return link_node->bcast_own_sum;
+}
+
+/* our last packet sent on the interface of the link was echoed by the neighbour */
+void bcast_own_mark(struct link_node *link_node)
+{
+	bcast_own_sync(link_node);
+
+	if (get_bit_status(link_node->bcast_own, 0, 0))
+		return;
+
+	bit_mark(link_node->bcast_own, 0);
+	link_node->bcast_own_sum++;
+}
+
 /* needed for hash, compares 2 struct orig_node, but only their mac-addresses. assumes that
  * the mac address is the first field in the struct */
 int32_t compare_orig( void *data1, void *data2 ) {
@@ -80,7 +290,7 @@ int32_t choose_orig( void *data, int32_t size ) {
 
 
 struct orig_node *find_orig_node( uint8_t *addr ) {
-	return ( (struct orig_node *) hash_find( orig_hash, addr ) );
+	return ( (struct orig_node *) hash_find( orig_hash[ORIG_SHARD(addr)], addr ) );
 		/* addr is supposed to be the first entry in the struct orig_node entry, so
 		* we don't allocate and copy into a new struct orig_node. should be enough for comparing. */
 
@@ -91,17 +301,26 @@ struct orig_node *find_orig_node( uint8_t *addr ) {
 /* this function finds or creates an originator entry for the given address if it does not exits */
 struct orig_node *get_orig_node( uint8_t *addr ) {
 
-	struct hashtable_t *swaphash;
+	struct hashtable_t *swaphash, **shard;
 	struct orig_node *orig_node = find_orig_node( addr );
 
 	if ( orig_node != NULL )
 		return orig_node;
 
+	shard = &orig_hash[ORIG_SHARD(addr)];
+
 	debug_output(4, "Creating new originator: %s \n", addr_to_string_static(addr));
 
-	orig_node = debugMalloc( sizeof(struct orig_node), 401 );
-	memset(orig_node, 0, sizeof(struct orig_node));
-	INIT_LIST_HEAD_FIRST( orig_node->neigh_list );
+	/* the size of the sequence number windows is only known at runtime - they follow the structure */
+	orig_node = pool_alloc( &orig_pool );
+	memset( orig_node, 0, orig_pool.obj_size );
+	INIT_DLIST_HEAD(&orig_node->neigh_list);
+	INIT_DLIST_HEAD(&orig_node->rank_list);
+	dlist_add(&orig_node->expiry_list, &orig_expiry_list);
+
+	orig_node->seq_bits = (TYPE_OF_WORD *)(orig_node + 1);
+	orig_node->real_bits = orig_node->seq_bits + local_win_words;
+	orig_node->if_router = (struct neigh_node **)(orig_node->real_bits + local_win_words);
 
 	memcpy( &orig_node->orig, addr, sizeof(orig_node->orig) );
 	orig_node->router = NULL;
@@ -110,17 +329,21 @@ struct orig_node *get_orig_node( uint8_t *addr ) {
 	orig_node->num_hna = 0;
 	INIT_DLIST_HEAD(&orig_node->hna_list);
 
-	orig_node->bcast_own = debugMalloc( found_ifs * sizeof(TYPE_OF_WORD) * NUM_WORDS, 402 );
-	memset( orig_node->bcast_own, 0, found_ifs * sizeof(TYPE_OF_WORD) * NUM_WORDS );
+	hash_add( *shard, orig_node );
+
+	if ( orig_num == orig_index_size ) {
 
-	orig_node->bcast_own_sum = debugMalloc( found_ifs * sizeof(uint8_t), 403 );
-	memset( orig_node->bcast_own_sum, 0, found_ifs * sizeof(uint8_t) );
+		orig_index_size = ( orig_index_size > 0 ? orig_index_size * 2 : 128 );
+		orig_index = debugRealloc( orig_index, orig_index_size * sizeof(struct orig_node *), 406 );
 
-	hash_add( orig_hash, orig_node );
+	}
 
-	if ( orig_hash->elements * 4 > orig_hash->size ) {
+	orig_node->index = orig_num;
+	orig_index[orig_num++] = orig_node;
 
-		swaphash = hash_resize( orig_hash, orig_hash->size * 2 );
+	if ( (*shard)->elements * 4 > (*shard)->size ) {
+
+		swaphash = hash_resize( *shard, (*shard)->size * 2 );
 
 		if ( swaphash == NULL ) {
 
@@ -129,7 +352,7 @@ struct orig_node *get_orig_node( uint8_t *addr ) {
 
 		}
 
-		orig_hash = swaphash;
+		*shard = swaphash;
 
 	}
 
@@ -139,40 +362,208 @@ struct orig_node *get_orig_node( uint8_t *addr ) {
 
 
 
-void update_orig(struct orig_node *orig_node, uint8_t *neigh, struct batman_packet *in, struct batman_if *if_incoming, unsigned char *hna_recv_buff, int16_t hna_buff_len, uint8_t is_duplicate, uint32_t rcvd_time)
+/* a neighbour ranks higher if it has the better tq value or the same tq value but more of our packets were echoed by it */
+static int neigh_better(struct neigh_node *neigh_node, struct neigh_node *other_neigh_node)
+{
+	int diff = metric->compare(neigh_node->tq_avg, other_neigh_node->tq_avg);
+
+	if (diff != 0)
+		return (diff > 0);
+
+	return (bcast_own_sync(neigh_node->link) > bcast_own_sync(other_neigh_node->link));
+}
+
+/* the ranking of the neighbour changed - move it to its new position within the (otherwise sorted) rank list */
+static void neigh_rank_update(struct orig_node *orig_node, struct neigh_node *neigh_node)
+{
+	struct dlist_head *pos;
+
+	for (pos = neigh_node->rank_list.prev; pos != &orig_node->rank_list; pos = pos->prev) {
+
+		if (!neigh_better(neigh_node, dlist_entry(pos, struct neigh_node, rank_list)))
+			break;
+
+	}
+
+	if (pos != neigh_node->rank_list.prev) {
+
+		dlist_del(&neigh_node->rank_list);
+		dlist_add(&neigh_node->rank_list, pos);
+		return;
+
+	}
+
+	for (pos = neigh_node->rank_list.next; pos != &orig_node->rank_list; pos = pos->next) {
+
+		if (!neigh_better(dlist_entry(pos, struct neigh_node, rank_list), neigh_node))
+			break;
+
+	}
+
+	if (pos != neigh_node->rank_list.next) {
+
+		dlist_del(&neigh_node->rank_list);
+		dlist_add_tail(&neigh_node->rank_list, pos);
+
+	}
+}
+
+/* remember the best neighbour per interface - the rank list is sorted already */
+static void orig_if_router_update(struct orig_node *orig_node)
+{
+	struct dlist_head *pos;
+	struct neigh_node *neigh_node;
+
+	if (found_ifs < 2)
+		return;
+
+	memset(orig_node->if_router, 0, found_ifs * sizeof(struct neigh_node *));
+
+	dlist_for_each(pos, &orig_node->rank_list) {
+
+		neigh_node = dlist_entry(pos, struct neigh_node, rank_list);
+
+		if (orig_node->if_router[neigh_node->link->if_incoming->if_num] == NULL)
+			orig_node->if_router[neigh_node->link->if_incoming->if_num] = neigh_node;
+
+	}
+}
+
+/* spread the packets over the neighbours ranked within the bonding tolerance of the best one (see -B) */
+static struct neigh_node *orig_bond_router(struct orig_node *orig_node, uint32_t flow_hash)
 {
-	struct list_head *list_pos;
-	struct neigh_node *neigh_node = NULL, *tmp_neigh_node = NULL, *best_neigh_node = NULL;
-	uint8_t max_tq = 0, max_bcast_own = 0;
+	struct dlist_head *pos;
+	struct neigh_node *best_neigh_node, *neigh_node = NULL;
+	uint16_t candidates = 0, pick;
+
+	best_neigh_node = dlist_entry(orig_node->rank_list.next, struct neigh_node, rank_list);
+
+	dlist_for_each(pos, &orig_node->rank_list) {
+
+		neigh_node = dlist_entry(pos, struct neigh_node, rank_list);
+
+		if ((neigh_node->tq_avg == 0) || (metric->compare(best_neigh_node->tq_avg, neigh_node->tq_avg) > bonding_tolerance))
+			break;
+
+		candidates++;
+
+	}
+
+	if (candidates < 2) {
+
+		orig_node->router->bond_packets++;
+		return orig_node->router;
+
+	}
+
+	pick = (bonding_mode == BONDING_ROUND_ROBIN ? orig_node->bond_next++ : flow_hash) % candidates;
+
+	dlist_for_each(pos, &orig_node->rank_list) {
+
+		neigh_node = dlist_entry(pos, struct neigh_node, rank_list);
+
+		if (pick-- == 0)
+			break;
+
+	}
+
+	neigh_node->bond_packets++;
+	return neigh_node;
+}
+
+/* the neighbour a unicast packet towards the originator is sent to - if_incoming is
+ * NULL for our own packets, flow_hash only matters in the per flow bonding mode.
+ * Half duplex radios do better if a relayed packet leaves via another interface
+ * than the one it arrived on (see -I) */
+struct neigh_node *orig_forw_router(struct orig_node *orig_node, struct batman_if *if_incoming, uint32_t flow_hash)
+{
+	struct neigh_node *router = orig_node->router, *alt_router = NULL;
+	int16_t i;
+
+	if ((bonding_mode != BONDING_OFF) && (router != NULL))
+		return orig_bond_router(orig_node, flow_hash);
+
+	if ((if_alt_margin == 0) || (found_ifs < 2) || (router == NULL) || (router->link->if_incoming != if_incoming))
+		return router;
+
+	for (i = 0; i < found_ifs; i++) {
+
+		if ((i == if_incoming->if_num) || (orig_node->if_router[i] == NULL) || (orig_node->if_router[i]->tq_avg == 0))
+			continue;
+
+		if ((alt_router == NULL) || (metric->compare(orig_node->if_router[i]->tq_avg, alt_router->tq_avg) > 0))
+			alt_router = orig_node->if_router[i];
+
+	}
+
+	if ((alt_router == NULL) || (metric->compare(router->tq_avg, alt_router->tq_avg) >= if_alt_margin))
+		return router;
+
+	if_alt_packets++;
+	return alt_router;
+}
+
+/* the best ranked neighbour - the current router is kept as long as nobody has a better tq value (to avoid route flipping),
+ * with the hysteresis (see -y and -Y) as long as nobody is clearly better and the router did not fail */
+static struct neigh_node *neigh_rank_best(struct orig_node *orig_node)
+{
+	struct neigh_node *best_neigh_node, *router = orig_node->router;
+
+	if (dlist_empty(&orig_node->rank_list))
+		return NULL;
+
+	best_neigh_node = dlist_entry(orig_node->rank_list.next, struct neigh_node, rank_list);
+
+	if ((router == NULL) || (router == best_neigh_node))
+		return best_neigh_node;
+
+	if (router->tq_avg == best_neigh_node->tq_avg)
+		return router;
+
+	if (router->tq_avg == 0)
+		return best_neigh_node;
+
+	if ((metric->compare(best_neigh_node->tq_avg, router->tq_avg) <= route_hyst_tq) ||
+	    ((int)(orig_node->route_changed + route_hold_time - curr_time) > 0)) {
+
+		route_changes_kept++;
+		return router;
+
+	}
+
+	return best_neigh_node;
+}
+
+
+
+void update_orig(struct orig_node *orig_node, struct link_node *link_node, struct batman_packet *in, unsigned char *hna_recv_buff, int16_t hna_buff_len, uint8_t is_duplicate, uint32_t rcvd_time)
+{
+	struct dlist_head *list_pos;
+	struct neigh_node *neigh_node = NULL, *tmp_neigh_node = NULL;
+	uint8_t tq_avg;
 	int16_t tmp_hna_buff_len;
 
 
 	debug_output( 4, "update_originator(): Searching and updating originator entry of received packet,  \n" );
 
 
-	list_for_each( list_pos, &orig_node->neigh_list ) {
+	dlist_for_each( list_pos, &orig_node->neigh_list ) {
 
-		tmp_neigh_node = list_entry( list_pos, struct neigh_node, list );
+		tmp_neigh_node = dlist_entry( list_pos, struct neigh_node, list );
 
-		if ((compare_orig(tmp_neigh_node->addr, neigh) == 0) && ( tmp_neigh_node->if_incoming == if_incoming)) {
+		if ( tmp_neigh_node->link == link_node ) {
 
 			neigh_node = tmp_neigh_node;
 
-		} else {
-
-			if ( !is_duplicate ) {
-
-				ring_buffer_set(tmp_neigh_node->tq_recv, &tmp_neigh_node->tq_index, 0);
-				tmp_neigh_node->tq_avg = ring_buffer_avg(tmp_neigh_node->tq_recv);
+		} else if ( !is_duplicate ) {
 
-			}
+			ring_buffer_set(&tmp_neigh_node->tq_ring, 0);
+			tq_avg = ring_buffer_avg(&tmp_neigh_node->tq_ring);
 
-			/* if we got have a better tq value via this neighbour or same tq value if it is currently our best neighbour (to avoid route flipping) */
-			if ( ( tmp_neigh_node->tq_avg > max_tq ) || ( ( tmp_neigh_node->tq_avg == max_tq ) && ( tmp_neigh_node->orig_node->bcast_own_sum[if_incoming->if_num] > max_bcast_own ) ) || ( ( orig_node->router == tmp_neigh_node ) && ( tmp_neigh_node->tq_avg == max_tq ) ) ) {
+			if ( tq_avg != tmp_neigh_node->tq_avg ) {
 
-				max_tq = tmp_neigh_node->tq_avg;
-				max_bcast_own = tmp_neigh_node->orig_node->bcast_own_sum[if_incoming->if_num];
-				best_neigh_node = tmp_neigh_node;
+				tmp_neigh_node->tq_avg = tq_avg;
+				neigh_rank_update(orig_node, tmp_neigh_node);
 
 			}
 
@@ -182,7 +573,7 @@ void update_orig(struct orig_node *orig_node, uint8_t *neigh, struct batman_pack
 
 	if ( neigh_node == NULL ) {
 
-		neigh_node = create_neighbor(orig_node, get_orig_node(neigh), neigh, if_incoming);
+		neigh_node = create_neighbor(orig_node, link_node);
 
 	} else {
 
@@ -190,10 +581,18 @@ void update_orig(struct orig_node *orig_node, uint8_t *neigh, struct batman_pack
 
 	}
 
-	neigh_node->last_valid = rcvd_time;
+	neigh_node_refresh(neigh_node, rcvd_time);
+
+	ring_buffer_set(&neigh_node->tq_ring, in->tq);
+	tq_avg = ring_buffer_avg(&neigh_node->tq_ring);
+
+	if ((orig_node->router == neigh_node) && (abs(tq_avg - neigh_node->tq_avg) > ORIG_INTERVAL_TQ_DELTA))
+		orig_interval_reset();
 
-	ring_buffer_set(neigh_node->tq_recv, &neigh_node->tq_index, in->tq);
-	neigh_node->tq_avg = ring_buffer_avg(neigh_node->tq_recv);
+	neigh_node->tq_avg = tq_avg;
+
+	/* the echo count used as tie breaker may have changed as well */
+	neigh_rank_update(orig_node, neigh_node);
 
 // 	is_new_seqno = bit_get_packet( neigh_node->seq_bits, in->seqno - orig_node->last_seqno, 1 );
 // 	is_new_seqno = ! get_bit_status( neigh_node->real_bits, orig_node->last_real_seqno, in->seqno );
@@ -206,19 +605,12 @@ void update_orig(struct orig_node *orig_node, uint8_t *neigh, struct batman_pack
 
 	}
 
-
-	if ( ( neigh_node->tq_avg > max_tq ) || ( ( neigh_node->tq_avg == max_tq ) && ( neigh_node->orig_node->bcast_own_sum[if_incoming->if_num] > max_bcast_own ) ) || ( ( orig_node->router == neigh_node ) && ( neigh_node->tq_avg == max_tq ) ) ) {
-
-		max_tq = neigh_node->tq_avg;
-		max_bcast_own = neigh_node->orig_node->bcast_own_sum[if_incoming->if_num];
-		best_neigh_node = neigh_node;
-
-	}
-
 	tmp_hna_buff_len = (hna_buff_len > in->num_hna * ETH_ALEN ? in->num_hna * ETH_ALEN : hna_buff_len);
 
+	orig_if_router_update(orig_node);
+
 	/* update routing table */
-	update_routes(orig_node, best_neigh_node, hna_recv_buff, tmp_hna_buff_len);
+	update_routes(orig_node, neigh_rank_best(orig_node), hna_recv_buff, tmp_hna_buff_len);
 
 	if ( orig_node->gwflags != in->gwflags )
 		update_gw_list( orig_node, in->gwflags );
@@ -228,123 +620,321 @@ void update_orig(struct orig_node *orig_node, uint8_t *neigh, struct batman_pack
 
 
 
+/* the neighbours of the originator were recreated from a snapshot (see snapshot_load()) - rank them and set up the routes as if their OGMs came in */
+void orig_restore_routes(struct orig_node *orig_node, unsigned char *hna_buff, int16_t hna_buff_len, uint8_t gwflags)
+{
+	struct neigh_node *neigh_node;
+
+	dlist_for_each_entry(neigh_node, &orig_node->neigh_list, list)
+		neigh_rank_update(orig_node, neigh_node);
+
+	orig_if_router_update(orig_node);
+
+	update_routes(orig_node, neigh_rank_best(orig_node), hna_buff, hna_buff_len);
+
+	if ( orig_node->gwflags != gwflags )
+		update_gw_list( orig_node, gwflags );
+
+	orig_node->gwflags = gwflags;
+}
+
+
+
+/* the neighbour timed out - choose a new router for the originator if necessary */
+static void purge_neigh(struct neigh_node *neigh_node)
+{
+	struct orig_node *orig_node = neigh_node->owner;
+	char str1[ETH_STR_LEN], str2[ETH_STR_LEN];
+
+	addr_to_string(str1, orig_node->orig);
+	addr_to_string(str2, neigh_node->link->addr);
+	debug_output(4, "Neighbour timeout: originator %s, neighbour %s, last_valid %u \n", str1, str2, neigh_node->last_valid);
+
+	dlist_del(&neigh_node->list);
+	dlist_del(&neigh_node->rank_list);
+	dlist_del(&neigh_node->expiry_list);
+
+	orig_if_router_update(orig_node);
+
+	/* the old router must not be looked at once it is freed */
+	if (orig_node->router == neigh_node)
+		orig_node->router = NULL;
+
+	/* the remaining neighbours are ranked as for a received OGM (see -y and -Y) */
+	update_routes(orig_node, neigh_rank_best(orig_node), orig_node->hna_buff, orig_node->hna_buff_len);
+
+	neigh_node->link->refcount--;
+	pool_free(&neigh_pool, neigh_node);
+}
+
+
+
 void purge_orig( uint32_t curr_time ) {
 
-	struct list_head *neigh_pos, *neigh_temp, *gw_pos, *gw_pos_tmp, *prev_list_head;
+	struct dlist_head *neigh_pos, *neigh_temp, *gw_pos, *gw_temp;
 	struct orig_node *orig_node;
-	struct neigh_node *neigh_node, *best_neigh_node;
+	struct neigh_node *neigh_node;
+	struct link_node *link_node;
 	struct gw_node *gw_node;
-	struct hash_it_t *hashit = NULL;
-	uint8_t gw_purged = 0, neigh_purged;
 
 
 	debug_output( 4, "purge() \n" );
 
-	/* for all origins... */
-	while ( NULL != ( hashit = hash_iterate( orig_hash, hashit ) ) ) {
+	/* only the originators at the head of the expiry list can have timed out */
+	while ( !dlist_empty( &orig_expiry_list ) ) {
 
-		orig_node = hashit->bucket->data;
+		orig_node = dlist_entry( orig_expiry_list.next, struct orig_node, expiry_list );
 
-		if ( (int)( ( orig_node->last_valid + PURGE_TIMEOUT ) < curr_time ) ) {
+		if ( !(int)( ( orig_node->last_valid + purge_timeout ) < curr_time ) )
+			break;
 
-			debug_output(4, "Originator timeout: originator %s, last_valid %u \n", addr_to_string_static(orig_node->orig), orig_node->last_valid);
+		debug_output(4, "Originator timeout: originator %s, last_valid %u \n", addr_to_string_static(orig_node->orig), orig_node->last_valid);
 
-			hash_remove_bucket( orig_hash, hashit );
+		hash_remove( orig_hash[ORIG_SHARD(orig_node->orig)], orig_node );
+		dlist_del( &orig_node->expiry_list );
 
-			/* for all neighbours towards this originator ... */
-			list_for_each_safe( neigh_pos, neigh_temp, &orig_node->neigh_list ) {
+		/* the last originator fills the gap */
+		orig_index[orig_node->index] = orig_index[--orig_num];
+		orig_index[orig_node->index]->index = orig_node->index;
 
-				neigh_node = list_entry( neigh_pos, struct neigh_node, list );
+		/* for all neighbours towards this originator ... */
+		dlist_for_each_safe( neigh_pos, neigh_temp, &orig_node->neigh_list ) {
 
-				list_del( (struct list_head *)&orig_node->neigh_list, neigh_pos, &orig_node->neigh_list );
-				debugFree( neigh_node, 1401 );
+			neigh_node = dlist_entry( neigh_pos, struct neigh_node, list );
 
-			}
+			dlist_del( &neigh_node->expiry_list );
+			neigh_node->link->refcount--;
+			pool_free( &neigh_pool, neigh_node );
 
-			list_for_each( gw_pos, &gw_list ) {
+		}
 
-				gw_node = list_entry( gw_pos, struct gw_node, list );
+		if ( orig_node->gw_node != NULL ) {
 
-				if ( gw_node->deleted )
-					continue;
+			debug_output(3, "Removing gateway %s from gateway list \n", addr_to_string_static(orig_node->orig));
 
-				if ( gw_node->orig_node == orig_node ) {
+			orig_node->gw_node->deleted = get_time();
 
-					debug_output(3, "Removing gateway %s from gateway list \n", addr_to_string_static(gw_node->orig_node->orig));
+		}
 
-					gw_node->deleted = get_time();
+		/* the gateway score drops to zero with the route */
+		update_routes( orig_node, NULL, NULL, 0 );
 
-					gw_purged = 1;
+		if ( orig_node->gw_node != NULL )
+			orig_node->gw_node->orig_node = NULL;
 
-					break;
+		pool_free( &orig_pool, orig_node );
 
-				}
+	}
 
-			}
+	/* same for the neighbours of the remaining originators */
+	while ( !dlist_empty( &neigh_expiry_list ) ) {
 
-			update_routes( orig_node, NULL, NULL, 0 );
+		neigh_node = dlist_entry( neigh_expiry_list.next, struct neigh_node, expiry_list );
 
-			debugFree( orig_node->bcast_own, 1402 );
-			debugFree( orig_node->bcast_own_sum, 1403 );
-			debugFree( orig_node, 1404 );
+		if ( !(int)( ( neigh_node->last_valid + purge_timeout ) < curr_time ) )
+			break;
 
-		} else {
+		purge_neigh( neigh_node );
 
-			best_neigh_node = NULL;
-			neigh_purged = 0;
-			prev_list_head = (struct list_head *)&orig_node->neigh_list;
+	}
 
-			/* for all neighbours towards this originator ... */
-			list_for_each_safe( neigh_pos, neigh_temp, &orig_node->neigh_list ) {
+	/* a link is refreshed with every packet of the routes via it - once it timed out these are gone as well */
+	while ( !dlist_empty( &link_expiry_list ) ) {
 
-				neigh_node = list_entry( neigh_pos, struct neigh_node, list );
+		link_node = dlist_entry( link_expiry_list.next, struct link_node, expiry_list );
 
-				if ( (int)( ( neigh_node->last_valid + PURGE_TIMEOUT ) < curr_time ) ) {
+		if ( ( !(int)( ( link_node->last_valid + purge_timeout ) < curr_time ) ) || ( link_node->refcount > 0 ) )
+			break;
 
-					neigh_purged = 1;
-					list_del( prev_list_head, neigh_pos, &orig_node->neigh_list );
-					debugFree( neigh_node, 1405 );
+		debug_output(4, "Link timeout: neighbour %s via %s, last_valid %u \n", addr_to_string_static(link_node->addr), link_node->if_incoming->dev, link_node->last_valid);
 
-				} else {
+		hash_remove( link_hash, link_node );
+		dlist_del( &link_node->expiry_list );
+		pool_free( &link_pool, link_node );
 
-					if ( ( best_neigh_node == NULL ) || ( neigh_node->tq_avg > best_neigh_node->tq_avg ) )
-						best_neigh_node = neigh_node;
+	}
 
-					prev_list_head = &neigh_node->list;
+	dlist_for_each_safe( gw_pos, gw_temp, &gw_list ) {
 
-				}
+		gw_node = dlist_entry( gw_pos, struct gw_node, list );
 
-			}
+		if ( ( gw_node->deleted ) && ( (int)((gw_node->deleted + (3 * purge_timeout)) < curr_time) ) ) {
+
+			if ( gw_node->orig_node != NULL )
+				gw_node->orig_node->gw_node = NULL;
 
-			if ( ( neigh_purged ) && ( ( best_neigh_node == NULL ) || ( orig_node->router == NULL ) || ( best_neigh_node->tq_avg > orig_node->router->tq_avg ) ) )
-				update_routes(orig_node, best_neigh_node, orig_node->hna_buff, orig_node->hna_buff_len);
+			dlist_del( gw_pos );
+			debugFree( gw_node, 1406 );
 
 		}
 
 	}
 
-	prev_list_head = (struct list_head *)&gw_list;
+}
+
+
+
+/* an entry or list head embedded in a moved structure - its neighbours have to point to the new location */
+static void dlist_relink(struct dlist_head *entry, struct dlist_head *old_entry)
+{
+	if (entry->next == old_entry) {
+
+		INIT_DLIST_HEAD(entry);
+		return;
+
+	}
+
+	entry->next->prev = entry;
+	entry->prev->next = entry;
+}
+
+/* the sequence number windows are allocated behind the originators and links - after
+ * the window size was changed at runtime all of them are moved into pools of the new
+ * object size, the newest old_words words of each window are kept (see config.c) */
+void orig_resize_local_win(uint8_t old_words)
+{
+	struct pool old_orig_pool = orig_pool, old_link_pool = link_pool;
+	struct hash_it_t *hashit = NULL;
+	struct orig_node *orig_node, *old_orig_node;
+	struct link_node *link_node, **old_links;
+	struct neigh_node *neigh_node;
+	uint32_t i, link_num = 0;
+
+	pool_init(&orig_pool, "orig_node", sizeof(struct orig_node) + 2 * local_win_words * sizeof(TYPE_OF_WORD) + found_ifs * sizeof(struct neigh_node *), POOL_SLAB, 401);
+	pool_init(&link_pool, "link_node", sizeof(struct link_node) + 2 * local_win_words * sizeof(TYPE_OF_WORD), POOL_SLAB, 405);
+
+	/* the old links stay intact until the neighbours were pointed to their successors */
+	old_links = debugMalloc((link_hash->elements > 0 ? link_hash->elements : 1) * sizeof(struct link_node *), 407);
+
+	while (NULL != (hashit = hash_iterate(link_hash, hashit)))
+		old_links[link_num++] = hashit->bucket->data;
+
+	for (i = 0; i < link_num; i++) {
+
+		link_node = pool_alloc(&link_pool);
+		memcpy(link_node, old_links[i], sizeof(struct link_node));
+		dlist_relink(&link_node->expiry_list, &old_links[i]->expiry_list);
+
+		link_node->real_bits = (TYPE_OF_WORD *)(link_node + 1);
+		link_node->bcast_own = link_node->real_bits + local_win_words;
 
-	list_for_each_safe( gw_pos, gw_pos_tmp, &gw_list ) {
+		bit_resize(link_node->real_bits, old_links[i]->real_bits, old_words);
+		bit_resize(link_node->bcast_own, old_links[i]->bcast_own, old_words);
 
-		gw_node = list_entry( gw_pos, struct gw_node, list );
+		link_node->real_packet_count = bit_packet_count(link_node->real_bits);
+		link_node->bcast_own_sum = bit_packet_count(link_node->bcast_own);
 
-		if ( ( gw_node->deleted ) && ( (int)((gw_node->deleted + (3 * PURGE_TIMEOUT)) < curr_time) ) ) {
+		if (link_node->real_seen > local_win_size)
+			link_node->real_seen = local_win_size;
 
-			list_del( prev_list_head, gw_pos, &gw_list );
-			debugFree( gw_pos, 1406 );
+		if (link_node->bcast_own_seen > local_win_size)
+			link_node->bcast_own_seen = local_win_size;
 
-		} else {
+		hash_remove(link_hash, old_links[i]);
+		hash_add(link_hash, link_node);
 
-			prev_list_head = &gw_node->list;
+	}
+
+	for (i = 0; i < orig_num; i++) {
+
+		old_orig_node = orig_index[i];
+
+		orig_node = pool_alloc(&orig_pool);
+		memcpy(orig_node, old_orig_node, sizeof(struct orig_node));
+		dlist_relink(&orig_node->neigh_list, &old_orig_node->neigh_list);
+		dlist_relink(&orig_node->rank_list, &old_orig_node->rank_list);
+		dlist_relink(&orig_node->expiry_list, &old_orig_node->expiry_list);
+		dlist_relink(&orig_node->hna_list, &old_orig_node->hna_list);
+
+		orig_node->seq_bits = (TYPE_OF_WORD *)(orig_node + 1);
+		orig_node->real_bits = orig_node->seq_bits + local_win_words;
+		orig_node->if_router = (struct neigh_node **)(orig_node->real_bits + local_win_words);
+
+		bit_resize(orig_node->seq_bits, old_orig_node->seq_bits, old_words);
+		bit_resize(orig_node->real_bits, old_orig_node->real_bits, old_words);
+		memcpy(orig_node->if_router, old_orig_node->if_router, found_ifs * sizeof(struct neigh_node *));
+
+		dlist_for_each_entry(neigh_node, &orig_node->neigh_list, list) {
+
+			neigh_node->owner = orig_node;
+			neigh_node->link = find_link_node(neigh_node->link->addr, neigh_node->link->if_incoming);
 
 		}
 
+		if (orig_node->gw_node != NULL)
+			orig_node->gw_node->orig_node = orig_node;
+
+		hash_remove(orig_hash[ORIG_SHARD(orig_node->orig)], old_orig_node);
+		hash_add(orig_hash[ORIG_SHARD(orig_node->orig)], orig_node);
+		orig_index[i] = orig_node;
+
+		pool_free(&old_orig_pool, old_orig_node);
+
 	}
 
-// 	if ( gw_purged > 0 )
-// 		choose_gw();
+	for (i = 0; i < link_num; i++)
+		pool_free(&old_link_pool, old_links[i]);
+
+	debugFree(old_links, 1407);
+
+	pool_destroy(&old_orig_pool);
+	pool_destroy(&old_link_pool);
+}
+
+/* the tq samples are allocated behind the neighbours - they are moved into a pool of
+ * the new object size and the newest samples of the old window are replayed (see config.c) */
+void orig_resize_global_win(uint8_t old_size)
+{
+	struct pool old_neigh_pool = neigh_pool;
+	struct dlist_head *neigh_pos, *neigh_temp;
+	struct orig_node *orig_node;
+	struct neigh_node *neigh_node, *old_neigh_node;
+	uint32_t i;
+	int16_t if_num;
+	uint8_t j, keep;
+
+	pool_init(&neigh_pool, "neigh_node", sizeof(struct neigh_node) + global_win_size, POOL_SLAB, 403);
+
+	keep = (old_size < global_win_size ? old_size : global_win_size);
+
+	for (i = 0; i < orig_num; i++) {
 
+		orig_node = orig_index[i];
+
+		dlist_for_each_safe(neigh_pos, neigh_temp, &orig_node->neigh_list) {
+
+			old_neigh_node = dlist_entry(neigh_pos, struct neigh_node, list);
+
+			neigh_node = pool_alloc(&neigh_pool);
+			memset(neigh_node, 0, neigh_pool.obj_size);
+			memcpy(neigh_node, old_neigh_node, sizeof(struct neigh_node));
+			dlist_relink(&neigh_node->list, &old_neigh_node->list);
+			dlist_relink(&neigh_node->rank_list, &old_neigh_node->rank_list);
+			dlist_relink(&neigh_node->expiry_list, &old_neigh_node->expiry_list);
+
+			/* the oldest sample is the one to be replaced next */
+			ring_buffer_init(&neigh_node->tq_ring, (uint8_t *)(neigh_node + 1));
+
+			for (j = old_size - keep; j < old_size; j++)
+				ring_buffer_set(&neigh_node->tq_ring, old_neigh_node->tq_ring.samples[(old_neigh_node->tq_ring.index + j) % old_size]);
+
+			if (orig_node->router == old_neigh_node)
+				orig_node->router = neigh_node;
+
+			for (if_num = 0; if_num < found_ifs; if_num++) {
+
+				if (orig_node->if_router[if_num] == old_neigh_node)
+					orig_node->if_router[if_num] = neigh_node;
+
+			}
+
+			pool_free(&old_neigh_pool, old_neigh_node);
+
+		}
+
+	}
+
+	pool_destroy(&old_neigh_pool);
 }
 
 
@@ -352,13 +942,17 @@ void purge_orig( uint32_t curr_time ) {
 void debug_orig() {
 
 	struct hash_it_t *hashit = NULL;
-	struct list_head *forw_pos, *orig_pos, *neigh_pos;
+	struct list_head *forw_pos, *orig_pos;
+	struct dlist_head *neigh_pos;
 	struct forw_node *forw_node;
 	struct orig_node *orig_node;
 	struct neigh_node *neigh_node;
+	struct link_node *link_node;
 	struct gw_node *gw_node;
-	uint16_t batman_count = 0;
-	uint32_t uptime_sec;
+	struct batman_if *batman_if;
+	char str1[ETH_STR_LEN], str2[ETH_STR_LEN];
+	uint16_t batman_count = 0, gw_count = 0;
+	uint32_t uptime_sec, ogms_per_frame, i;
 
 	uptime_sec = (uint32_t)( get_time() / 1000 );
 
@@ -367,36 +961,26 @@ void debug_orig() {
 		debug_output( 2, "BOD \n" );
 		debug_output( 2, "%''14s     (%s/%i) %''17s [%10s], gw_class ... [B.A.T.M.A.N. %s%s, MainIF/IP: %s/%s, UT: %id%2ih%2im] \n", "Gateway", "#", TQ_MAX_VALUE, "Nexthop", "outgoingIF", SOURCE_VERSION, ( strncmp( REVISION_VERSION, "0", 1 ) != 0 ? REVISION_VERSION : "" ), ((struct batman_if *)if_list.next)->dev, addr_to_string_static(((struct batman_if *)if_list.next)->hw_addr), uptime_sec/86400, ((uptime_sec%86400)/3600), ((uptime_sec)%3600)/60 );
 
-		if ( list_empty( &gw_list ) ) {
-
-			debug_output( 2, "No gateways in range ... \n" );
-
-		} else {
-
-			list_for_each( orig_pos, &gw_list ) {
+		dlist_for_each( neigh_pos, &gw_list ) {
 
-				gw_node = list_entry( orig_pos, struct gw_node, list );
+			gw_node = dlist_entry( neigh_pos, struct gw_node, list );
 
-				if ( gw_node->deleted )
-					continue;
+			/* the list is sorted - the unusable gateways are at the tail */
+			if ( gw_node->score == 0 )
+				break;
 
-				/*debug_output( 2, "%s %-17s (%3i) %''15s [%10s], gw_class %3i - %i%s/%i%s, reliability: %i \n", ( curr_gateway == gw_node ? "=>" : "  " ), str, gw_node->orig_node->router->tq_avg, str2, gw_node->orig_node->router->if_incoming->dev, gw_node->orig_node->gwflags, ( download_speed > 2048 ? download_speed / 1024 : download_speed ), ( download_speed > 2048 ? "MBit" : "KBit" ), ( upload_speed > 2048 ? upload_speed / 1024 : upload_speed ), ( upload_speed > 2048 ? "MBit" : "KBit" ), gw_node->unavail_factor );
+			addr_to_string( str1, gw_node->orig_node->orig );
+			addr_to_string( str2, gw_node->orig_node->router->link->addr );
 
-				if ( curr_gateway == gw_node ) {
-					debug_output( 2, "=> %-17s %''17s (%3i), gw_class %2i - %s, reliability: %i \n", addr_to_string( gw_node->orig_node->orig ), addr_to_string( gw_node->orig_node->router->addr ), gw_node->orig_node->router->packet_count, gw_node->orig_node->gwflags, gw2string[gw_node->orig_node->gwflags], gw_node->unavail_factor );
-				} else {
-					debug_output( 2, "   %-17s %''17s (%3i), gw_class %2i - %s, reliability: %i \n", addr_to_string( gw_node->orig_node->orig ), addr_to_string( gw_node->orig_node->router->addr ), gw_node->orig_node->router->packet_count, gw_node->orig_node->gwflags, gw2string[gw_node->orig_node->gwflags], gw_node->unavail_factor );
-				}*/
+			debug_output( 2, "%s %-17s (%3i) %''17s [%10s], gw_class %2i - %s, score: %u \n", ( curr_gateway == gw_node ? "=>" : "  " ), str1, gw_node->orig_node->router->tq_avg, str2, gw_node->orig_node->router->link->if_incoming->dev, gw_node->orig_node->gwflags, gw2string[gw_node->orig_node->gwflags], gw_node->score );
 
-			}
-
-			batman_count++;
-
-			if ( batman_count == 0 )
-				debug_output( 2, "No gateways in range ... \n" );
+			gw_count++;
 
 		}
 
+		if ( gw_count == 0 )
+			debug_output( 2, "No gateways in range ... \n" );
+
 		debug_output( 2, "EOD \n" );
 
 	}
@@ -409,21 +993,61 @@ void debug_orig() {
 		if ( debug_clients.clients_num[3] > 0 ) {
 
 			debug_output( 4, "------------------ DEBUG ------------------ \n" );
-			debug_output( 4, "Forward list \n" );
+			if ( originator_interval_max > 0 )
+				debug_output( 4, "Originator interval: %i ms (adaptive: %i - %i ms) \n", originator_interval_curr, originator_interval, originator_interval_max );
+			else
+				debug_output( 4, "Originator interval: %i ms \n", originator_interval_curr );
+
+			debug_output( 4, "Forward list (%u queued, %u coalesced, %u dropped) \n", forw_list_len, forw_coalesced, forw_dropped );
 
 			list_for_each( forw_pos, &forw_list ) {
 				forw_node = list_entry(forw_pos, struct forw_node, list);
 				debug_output(4, "    %s at %u \n", addr_to_string_static(((struct batman_packet *)forw_node->pack_buff)->orig), forw_node->send_time);
 			}
 
+			if ( aggregation_enabled ) {
+
+				debug_output( 4, "Aggregation \n" );
+
+				list_for_each( orig_pos, &if_list ) {
+					batman_if = list_entry(orig_pos, struct batman_if, list);
+					ogms_per_frame = ( batman_if->aggr_frames > 0 ? ( batman_if->aggr_ogms * 100 ) / batman_if->aggr_frames : 0 );
+					debug_output(4, "    %-10s %u OGMs in %u frames (%u.%02u OGMs/frame) \n", batman_if->dev, batman_if->aggr_ogms, batman_if->aggr_frames, ogms_per_frame / 100, ogms_per_frame % 100);
+				}
+
+			}
+
+			debug_output( 4, "Pools \n" );
+			pool_debug( &orig_pool );
+			pool_debug( &neigh_pool );
+			pool_debug( &link_pool );
+			pool_debug( &forw_pool );
+			hash_pool_debug();
+
+			debug_output( 4, "Links (%i), metric: %s \n", link_hash->elements, metric->name );
+
+			while ( NULL != ( hashit = hash_iterate( link_hash, hashit ) ) ) {
+				link_node = hashit->bucket->data;
+				debug_output(4, "    %-17s %-10s echos %3i, received %3i, local tq %3i, asym penalty %3i, throughput %u kbit/s, routes %i \n", addr_to_string_static(link_node->addr), link_node->if_incoming->dev, bcast_own_sync(link_node), link_node->real_packet_count, link_node->tq_own, link_node->tq_asym_penalty, link_node->throughput, link_node->refcount);
+			}
+
+			if ( dhcp_steering )
+				debug_output( 4, "DHCP steering: %u requests sent to the gateway, %u offers of other gateways dropped \n", dhcp_steered, dhcp_offers_dropped );
+
+			if ( if_alt_margin > 0 )
+				debug_output( 4, "Interface alternation: %i tq margin, %u packets relayed via another interface \n", if_alt_margin, if_alt_packets );
+
+			if ( ( route_hyst_tq > 0 ) || ( route_hold_time > 0 ) )
+				debug_output( 4, "Route hysteresis: %i tq, hold time %i ms (a better neighbour was ignored %u times) \n", route_hyst_tq, route_hold_time, route_changes_kept );
+
 			debug_output( 4, "Originator list \n" );
 			debug_output( 4, "  %-14s %''16s (%s/%i): %''20s\n", "Originator", "Router", "#", TQ_MAX_VALUE, "Potential routers" );
 
 		}
 
-		while ( NULL != ( hashit = hash_iterate( orig_hash, hashit ) ) ) {
+		for ( i = 0; i < orig_num; i++ ) {
 
-			orig_node = hashit->bucket->data;
+			orig_node = orig_index[i];
 
 			if ( orig_node->router == NULL )
 				continue;
@@ -432,15 +1056,18 @@ void debug_orig() {
 
 			/* addr_to_string create a static buffer which will be used for orig and router */
 			debug_output(1, "%-17s ", addr_to_string_static(orig_node->orig));
-			debug_output(1, "%''17s (%3i):", addr_to_string_static(orig_node->router->addr), orig_node->router->tq_avg);
+			debug_output(1, "%''17s (%3i):", addr_to_string_static(orig_node->router->link->addr), orig_node->router->tq_avg);
 			debug_output(4, "%-17s ", addr_to_string_static(orig_node->orig));
-			debug_output(4, "%''17s (%3i), last_valid: %u: \n", addr_to_string_static(orig_node->router->addr), orig_node->router->tq_avg, orig_node->last_valid);
+			debug_output(4, "%''17s (%3i), last_valid: %u, route changes: %u: \n", addr_to_string_static(orig_node->router->link->addr), orig_node->router->tq_avg, orig_node->last_valid, orig_node->route_flaps);
 
-			list_for_each( neigh_pos, &orig_node->neigh_list ) {
-				neigh_node = list_entry( neigh_pos, struct neigh_node, list );
+			dlist_for_each( neigh_pos, &orig_node->neigh_list ) {
+				neigh_node = dlist_entry( neigh_pos, struct neigh_node, list );
 
-				debug_output(1, " %''17s (%3i)", addr_to_string_static(neigh_node->addr), neigh_node->tq_avg);
-				debug_output(4, "\t\t%''17s (%3i) \n", addr_to_string_static(neigh_node->addr), neigh_node->tq_avg);
+				debug_output(1, " %''17s (%3i)", addr_to_string_static(neigh_node->link->addr), neigh_node->tq_avg);
+				if ( bonding_mode != BONDING_OFF )
+					debug_output(4, "\t\t%''17s (%3i), bonded packets: %u \n", addr_to_string_static(neigh_node->link->addr), neigh_node->tq_avg, neigh_node->bond_packets);
+				else
+					debug_output(4, "\t\t%''17s (%3i) \n", addr_to_string_static(neigh_node->link->addr), neigh_node->tq_avg);
 
 			}
 
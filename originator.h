@@ -21,12 +21,27 @@
 #include <stdint.h>		/* intXX_t types */
 #include "batman-adv.h"
 
-struct neigh_node * create_neighbor(struct orig_node *orig_node, struct orig_node *orig_neigh_node, uint8_t *neigh, struct batman_if *if_incoming);
+struct neigh_node * create_neighbor(struct orig_node *orig_node, struct link_node *link_node);
+void neigh_node_refresh(struct neigh_node *neigh_node, uint32_t curr_time);
+void orig_node_refresh(struct orig_node *orig_node, uint32_t curr_time);
+void link_node_refresh(struct link_node *link_node, uint32_t curr_time);
+int32_t compare_link( void *data1, void *data2 );
+int32_t choose_link( void *data, int32_t size );
+struct neigh_node *orig_forw_router(struct orig_node *orig_node, struct batman_if *if_incoming, uint32_t flow_hash);
+struct link_node *find_link_node( uint8_t *neigh, struct batman_if *if_incoming );
+struct link_node *get_link_node( uint8_t *neigh, struct batman_if *if_incoming );
+void link_sync_real_bits(struct orig_node *orig_neigh_node, struct link_node *link_node);
+void link_mark_real_bit(struct orig_node *orig_neigh_node, struct link_node *link_node, uint16_t seqno);
+uint16_t bcast_own_sync(struct link_node *link_node);
+void bcast_own_mark(struct link_node *link_node);
 int compare_orig( void *data1, void *data2 );
 int choose_orig( void *data, int32_t size );
 struct orig_node *find_orig_node( uint8_t *addr );
 struct orig_node *get_orig_node( uint8_t *addr );
-void update_orig(struct orig_node *orig_node, uint8_t *neigh, struct batman_packet *in, struct batman_if *if_incoming, unsigned char *hna_recv_buff, int16_t hna_buff_len, uint8_t is_duplicate, uint32_t rcvd_time);
+void update_orig(struct orig_node *orig_node, struct link_node *link_node, struct batman_packet *in, unsigned char *hna_recv_buff, int16_t hna_buff_len, uint8_t is_duplicate, uint32_t rcvd_time);
+void orig_restore_routes(struct orig_node *orig_node, unsigned char *hna_buff, int16_t hna_buff_len, uint8_t gwflags);
 void purge_orig( uint32_t curr_time );
+void orig_resize_local_win(uint8_t old_words);
+void orig_resize_global_win(uint8_t old_size);
 void debug_orig();
 
@@ -31,6 +31,7 @@ uint32_t get_time_sec( void );
 
 int8_t rawsock_create(char *devicename);
 int32_t rawsock_read( int32_t rawsock, struct ether_header *recv_header, unsigned char *buf, int16_t size );
+uint64_t rawsock_timestamp( int32_t rawsock );
 int32_t rawsock_write( int32_t rawsock, struct ether_header *send_header, unsigned char *buf, int16_t size );
 
 int8_t tap_probe();
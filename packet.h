@@ -25,6 +25,7 @@
 #define BAT_ICMP      0x02
 #define BAT_UNICAST   0x03
 #define BAT_BCAST     0x04
+#define BAT_PROBE     0x05
 
 
 #define COMPAT_VERSION 6
@@ -79,3 +80,11 @@ struct bcast_packet
 	uint16_t seqno;
 } __attribute__((packed));
 
+struct probe_packet
+{
+	uint8_t  packet_type;
+	uint8_t  version;  /* batman version field */
+	uint8_t  burst;    /* number of the probe burst - the rest of the probe is padding */
+	uint8_t  index;    /* position of the probe within the burst */
+	uint8_t  count;    /* number of probes within the burst */
+} __attribute__((packed));
@@ -0,0 +1,140 @@
+/* Copyright (C) 2008 B.A.T.M.A.N. contributors:
+ * Marek Lindner
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ *
+ */
+
+
+
+#include <stdio.h>		/* NULL */
+#include "pool.h"
+#include "os.h"
+#include "allocate.h"
+
+
+
+#define POOL_ALIGN 8
+
+
+
+void pool_init( struct pool *pool, char *name, uint32_t obj_size, uint16_t objs_per_slab, int32_t tag ) {
+
+	/* a free object has to hold the free list pointer */
+	if ( obj_size < sizeof(void *) )
+		obj_size = sizeof(void *);
+
+	pool->name = name;
+	pool->obj_size = ( obj_size + POOL_ALIGN - 1 ) & ~( POOL_ALIGN - 1 );
+	pool->objs_per_slab = objs_per_slab;
+	pool->tag = tag;
+	pool->free_list = NULL;
+	pool->slab_list = NULL;
+	pool->slabs = 0;
+	pool->in_use = 0;
+	pool->in_use_max = 0;
+	pool->allocs = 0;
+
+}
+
+
+
+/* all objects of a new slab are put on the free list at once */
+static void pool_grow( struct pool *pool ) {
+
+	unsigned char *slab, *obj;
+	uint16_t i;
+
+	slab = debugMalloc( POOL_ALIGN + pool->objs_per_slab * pool->obj_size, pool->tag );
+
+	*(void **)slab = pool->slab_list;
+	pool->slab_list = slab;
+	pool->slabs++;
+
+	obj = slab + POOL_ALIGN + ( pool->objs_per_slab - 1 ) * pool->obj_size;
+
+	for ( i = 0; i < pool->objs_per_slab; i++, obj -= pool->obj_size ) {
+
+		*(void **)obj = pool->free_list;
+		pool->free_list = obj;
+
+	}
+
+}
+
+
+
+/* the object is not cleared */
+void *pool_alloc( struct pool *pool ) {
+
+	void *obj;
+
+	if ( pool->free_list == NULL )
+		pool_grow( pool );
+
+	obj = pool->free_list;
+	pool->free_list = *(void **)obj;
+
+	pool->allocs++;
+	pool->in_use++;
+
+	if ( pool->in_use > pool->in_use_max )
+		pool->in_use_max = pool->in_use;
+
+	return obj;
+
+}
+
+
+
+void pool_free( struct pool *pool, void *obj ) {
+
+	*(void **)obj = pool->free_list;
+	pool->free_list = obj;
+
+	pool->in_use--;
+
+}
+
+
+
+void pool_destroy( struct pool *pool ) {
+
+	void *slab;
+
+	if ( pool->in_use > 0 )
+		debug_output( 0, "Error - pool %s destroyed with %u objects in use \n", pool->name, pool->in_use );
+
+	while ( pool->slab_list != NULL ) {
+
+		slab = pool->slab_list;
+		pool->slab_list = *(void **)slab;
+
+		debugFree( slab, 1000 + pool->tag );
+
+	}
+
+	pool->free_list = NULL;
+	pool->slabs = 0;
+
+}
+
+
+
+void pool_debug( struct pool *pool ) {
+
+	debug_output( 4, "    %-10s %u in use (max %u), %u slabs of %u x %u bytes, %u allocations \n", pool->name, pool->in_use, pool->in_use_max, pool->slabs, pool->objs_per_slab, pool->obj_size, pool->allocs );
+
+}
@@ -0,0 +1,53 @@
+/* Copyright (C) 2008 B.A.T.M.A.N. contributors:
+ * Marek Lindner
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ *
+ */
+
+
+
+#ifndef _BATMAN_POOL_H
+#define _BATMAN_POOL_H
+
+#include <stdint.h>
+
+
+
+/* objects of one size are carved out of slabs - freed objects are kept on a
+ * free list for the next allocation, the slabs are released with pool_destroy() */
+struct pool
+{
+	char *name;
+	uint32_t obj_size;        /* rounded up to keep the objects aligned */
+	uint16_t objs_per_slab;
+	int32_t tag;              /* debugMalloc() tag of the slabs */
+	void *free_list;          /* a free object starts with the pointer to the next one */
+	void *slab_list;          /* a slab starts with the pointer to the next one */
+	uint32_t slabs;
+	uint32_t in_use;
+	uint32_t in_use_max;
+	uint32_t allocs;
+};
+
+
+
+void pool_init( struct pool *pool, char *name, uint32_t obj_size, uint16_t objs_per_slab, int32_t tag );
+void *pool_alloc( struct pool *pool );
+void pool_free( struct pool *pool, void *obj );
+void pool_destroy( struct pool *pool );
+void pool_debug( struct pool *pool );
+
+#endif
@@ -39,11 +39,17 @@
 #include <fcntl.h>
 #include <syslog.h>
 #include <paths.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <netinet/ether.h>
 
 #include "os.h"
 #include "batman-adv.h"
 #include "originator.h"
 #include "trans_table.h"
+#include "probe.h"
+#include "config.h"
 
 
 
@@ -204,7 +210,7 @@ void handle_packet( unsigned char *buff, int32_t buff_len, struct unix_client *u
 		if ( ( orig_node != NULL ) && ( orig_node->batman_if != NULL ) && ( orig_node->router != NULL ) && ( icmp_packet->ttl > 0 ) ) {
 
 			memcpy( ether_header.ether_shost, orig_node->batman_if->hw_addr, ETH_ALEN );
-			memcpy( ether_header.ether_dhost, orig_node->router->addr, ETH_ALEN );
+			memcpy( ether_header.ether_dhost, orig_node->router->link->addr, ETH_ALEN );
 
 			icmp_packet->uid = unix_client->uid;
 			memcpy( icmp_packet->orig, orig_node->batman_if->hw_addr, ETH_ALEN );
@@ -244,6 +250,7 @@ void *unix_listen( void BATUNUSED(*arg) ) {
 	int8_t res;
 	uint8_t i;
 	unsigned char buff[50];
+	char config_buff[1000];
 	fd_set wait_sockets, tmp_wait_sockets;
 	socklen_t sun_size = sizeof(struct sockaddr_un);
 
@@ -409,6 +416,19 @@ void *unix_listen( void BATUNUSED(*arg) ) {
 
 								}
 
+							} else if ( buff[0] == 'c' ) {
+
+								/* "c:name=value" changes a parameter, "c:" prints all of them */
+								buff[ status < (int32_t)sizeof(buff) ? status : (int32_t)sizeof(buff) - 1 ] = '\0';
+
+								if ( ( status > 2 ) && ( buff[2] != '\0' ) )
+									config_set( (char *)buff + 2, config_buff, sizeof(config_buff), 1 );
+								else
+									config_print( config_buff, sizeof(config_buff) );
+
+								if ( ( write( unix_client->sock, config_buff, strlen( config_buff ) ) < 0 ) || ( write( unix_client->sock, "EOD\n", 4 ) < 0 ) )
+									debug_output( 0, "Error - can't write to unix client: %s\n", strerror(errno) );
+
 							}
 
 						} else {
@@ -516,14 +536,87 @@ void *unix_listen( void BATUNUSED(*arg) ) {
 
 
 
+static uint8_t pref_gateway_addr[ETH_ALEN];
+
+
+
+/* connect to the running batmand - the client modes (-c) talk to it via unix_if.unix_sock */
+static void unix_connect( void ) {
+
+	unix_if.unix_sock = socket(AF_LOCAL, SOCK_STREAM, 0);
+
+	memset( &unix_if.addr, 0, sizeof(struct sockaddr_un) );
+	unix_if.addr.sun_family = AF_LOCAL;
+	strcpy( unix_if.addr.sun_path, UNIX_PATH );
+
+	if ( connect ( unix_if.unix_sock, (struct sockaddr *)&unix_if.addr, sizeof(struct sockaddr_un) ) < 0 ) {
+
+		printf( "Error - can't connect to unix socket '%s': %s ! Is batmand running on this host ?\n", UNIX_PATH, strerror(errno) );
+		close( unix_if.unix_sock );
+		exit(EXIT_FAILURE);
+
+	}
+
+}
+
+
+
+/* send a parameter change (or an empty setting to get all parameters) and print the reply - returns 0 if it was refused */
+static int unix_config( char *setting ) {
+
+	char buff[1001];
+	int32_t recv_buff_len, buff_len = 0;
+
+	unix_connect();
+
+	snprintf( buff, sizeof(buff), "c:%s", setting );
+
+	if ( write( unix_if.unix_sock, buff, strlen( buff ) + 1 ) < 0 ) {
+
+		printf( "Error - can't write to unix socket: %s\n", strerror(errno) );
+		close( unix_if.unix_sock );
+		exit(EXIT_FAILURE);
+
+	}
+
+	/* the reply ends with "EOD" */
+	while ( ( buff_len < (int32_t)sizeof(buff) - 1 ) && ( ( recv_buff_len = read( unix_if.unix_sock, buff + buff_len, sizeof(buff) - 1 - buff_len ) ) > 0 ) ) {
+
+		buff_len += recv_buff_len;
+		buff[buff_len] = '\0';
+
+		if ( ( buff_len >= 4 ) && ( strcmp( buff + buff_len - 4, "EOD\n" ) == 0 ) )
+			break;
+
+	}
+
+	close( unix_if.unix_sock );
+
+	buff[buff_len] = '\0';
+
+	if ( ( buff_len >= 4 ) && ( strcmp( buff + buff_len - 4, "EOD\n" ) == 0 ) )
+		buff[buff_len - 4] = '\0';
+
+	printf( "%s", buff );
+
+	return ( strncmp( buff, "Error", 5 ) != 0 );
+
+}
+
+
+
 void apply_init_args( int argc, char *argv[] ) {
 
 	struct in_addr tmp_ip_holder;
+	struct ether_addr *tmp_ether_addr;
 	struct batman_if *batman_if;
 	struct debug_level_info *debug_level_info;
 	uint8_t found_args = 1, batch_mode = 0;
 	uint16_t tmp_mtu;
+	int32_t tmp_val;
 	int8_t res;
+	char *config_args[CONFIG_ARGS_MAX], config_msg[200];
+	uint8_t config_num = 0, i;
 
 	int32_t optchar, recv_buff_len, bytes_written;
 	char *unix_buff, *buff_ptr, *cr_ptr;
@@ -536,10 +629,33 @@ void apply_init_args( int argc, char *argv[] ) {
 
 	printf( "WARNING: You are using the unstable batman-advanced branch. If you are interested in *using* batman-advanced get the latest stable release !\n" );
 
-	while ( ( optchar = getopt ( argc, argv, "bcd:hHo:g:p:r:s:vV" ) ) != -1 ) {
+	while ( ( optchar = getopt ( argc, argv, "aA:bB:cd:DE:f:hHI:m:o:O:g:p:P:r:s:S:T:vVw:W:y:Y:" ) ) != -1 ) {
 
 		switch ( optchar ) {
 
+			case 'a':
+				aggregation_enabled = 1;
+				found_args++;
+				break;
+
+			case 'A':
+
+				errno = 0;
+				tmp_val = strtol(optarg, NULL, 10);
+
+				/* the limit depends on purge_timeout (see -O) and is checked once all options are known */
+				if ( ( tmp_val < 1 ) || ( tmp_val > INT16_MAX ) ) {
+
+					printf( "Invalid maximal originator interval specified: %i.\nThe interval has to be between 1 and %i.\n", tmp_val, INT16_MAX );
+					exit(EXIT_FAILURE);
+
+				}
+
+				originator_interval_max = tmp_val;
+
+				found_args += 2;
+				break;
+
 			case 'b':
 				batch_mode++;
 				break;
@@ -566,6 +682,23 @@ void apply_init_args( int argc, char *argv[] ) {
 				found_args += 2;
 				break;
 
+			case 'f':
+
+				errno = 0;
+				tmp_val = strtol(optarg, NULL, 10);
+
+				if ( ( tmp_val < 1 ) || ( tmp_val > ttl ) ) {
+
+					printf( "Invalid fisheye radius specified: %i.\nThe radius has to be between 1 and %i.\n", tmp_val, ttl );
+					exit(EXIT_FAILURE);
+
+				}
+
+				fisheye_radius = tmp_val;
+
+				found_args += 2;
+				break;
+
 			case 'g':
 
 				errno = 0;
@@ -603,17 +736,32 @@ void apply_init_args( int argc, char *argv[] ) {
 				found_args += 2;
 				break;
 
+			case 'O':
+
+				if ( config_num == CONFIG_ARGS_MAX ) {
+
+					printf( "Too many parameters specified - at most %i -O options can be given.\n", CONFIG_ARGS_MAX );
+					exit(EXIT_FAILURE);
+
+				}
+
+				config_args[config_num++] = optarg;
+
+				found_args += 2;
+				break;
+
 			case 'p':
 
 				errno = 0;
-				if ( inet_pton(AF_INET, optarg, &tmp_ip_holder) < 1 ) {
+				if ( ( tmp_ether_addr = ether_aton( optarg ) ) == NULL ) {
 
-					printf( "Invalid preferred gateway IP specified: %s\n", optarg );
+					printf( "Invalid preferred gateway mac address specified: %s\n", optarg );
 					exit(EXIT_FAILURE);
 
 				}
 
-				pref_gateway = tmp_ip_holder.s_addr;
+				memcpy( pref_gateway_addr, tmp_ether_addr, ETH_ALEN );
+				pref_gateway = pref_gateway_addr;
 
 				found_args += 2;
 				break;
@@ -646,6 +794,21 @@ void apply_init_args( int argc, char *argv[] ) {
 				vis_server = tmp_ip_holder.s_addr;
 
 
+				found_args += 2;
+				break;
+
+			case 'S':
+
+				/* the snapshot is written to "<file>.tmp" first */
+				if ( strlen( optarg ) > 250 ) {
+
+					printf( "Invalid snapshot file specified: %s\nThe path must not be longer than 250 characters.\n", optarg );
+					exit(EXIT_FAILURE);
+
+				}
+
+				snapshot_file = optarg;
+
 				found_args += 2;
 				break;
 
@@ -663,6 +826,184 @@ void apply_init_args( int argc, char *argv[] ) {
 
 				exit(0);
 
+			case 'w':
+
+				errno = 0;
+				tmp_val = strtol(optarg, NULL, 10);
+
+				if ( ( tmp_val < TQ_LOCAL_WINDOW_MIN ) || ( tmp_val > TQ_LOCAL_WINDOW_MAX ) ) {
+
+					printf( "Invalid window size specified: %i.\nThe window size has to be between %i and %i.\n", tmp_val, TQ_LOCAL_WINDOW_MIN, TQ_LOCAL_WINDOW_MAX );
+					exit(EXIT_FAILURE);
+
+				}
+
+				bit_set_window( tmp_val );
+
+				found_args += 2;
+				break;
+
+			case 'W':
+
+				errno = 0;
+				tmp_val = strtol(optarg, NULL, 10);
+
+				if ( ( tmp_val < 1 ) || ( tmp_val > TQ_GLOBAL_WINDOW_MAX ) ) {
+
+					printf( "Invalid tq average window size specified: %i.\nThe window size has to be between 1 and %i.\n", tmp_val, TQ_GLOBAL_WINDOW_MAX );
+					exit(EXIT_FAILURE);
+
+				}
+
+				global_win_size = tmp_val;
+
+				found_args += 2;
+				break;
+
+			case 'E':
+
+				errno = 0;
+				tmp_val = strtol(optarg, NULL, 10);
+
+				if ( ( tmp_val < 0 ) || ( tmp_val > TQ_EWMA_SHIFT_MAX ) ) {
+
+					printf( "Invalid tq moving average weight specified: %i.\nThe weight has to be between 0 and %i.\n", tmp_val, TQ_EWMA_SHIFT_MAX );
+					exit(EXIT_FAILURE);
+
+				}
+
+				tq_ewma_shift = tmp_val;
+
+				found_args += 2;
+				break;
+
+			case 'y':
+
+				errno = 0;
+				tmp_val = strtol(optarg, NULL, 10);
+
+				if ( ( tmp_val < 0 ) || ( tmp_val > TQ_MAX_VALUE ) ) {
+
+					printf( "Invalid route hysteresis specified: %i.\nThe hysteresis has to be between 0 and %i.\n", tmp_val, TQ_MAX_VALUE );
+					exit(EXIT_FAILURE);
+
+				}
+
+				route_hyst_tq = tmp_val;
+
+				found_args += 2;
+				break;
+
+			case 'Y':
+
+				errno = 0;
+				tmp_val = strtol(optarg, NULL, 10);
+
+				/* the limit depends on purge_timeout (see -O) and is checked once all options are known */
+				if ( ( tmp_val < 0 ) || ( tmp_val > UINT16_MAX ) ) {
+
+					printf( "Invalid route hold time specified: %i ms.\nThe hold time has to be between 0 and %i ms.\n", tmp_val, UINT16_MAX );
+					exit(EXIT_FAILURE);
+
+				}
+
+				route_hold_time = tmp_val;
+
+				found_args += 2;
+				break;
+
+			case 'D':
+
+				dhcp_steering = 1;
+				found_args++;
+				break;
+
+			case 'B':
+
+				errno = 0;
+				tmp_val = strtol(optarg, NULL, 10);
+
+				if ( ( tmp_val < BONDING_OFF ) || ( tmp_val > BONDING_FLOW_HASH ) ) {
+
+					printf( "Invalid bonding mode specified: %i.\nThe mode has to be between %i and %i.\n", tmp_val, BONDING_OFF, BONDING_FLOW_HASH );
+					exit(EXIT_FAILURE);
+
+				}
+
+				bonding_mode = tmp_val;
+
+				found_args += 2;
+				break;
+
+			case 'T':
+
+				errno = 0;
+				tmp_val = strtol(optarg, NULL, 10);
+
+				if ( ( tmp_val < 0 ) || ( tmp_val > TQ_MAX_VALUE ) ) {
+
+					printf( "Invalid bonding tolerance specified: %i.\nThe tolerance has to be between 0 and %i.\n", tmp_val, TQ_MAX_VALUE );
+					exit(EXIT_FAILURE);
+
+				}
+
+				bonding_tolerance = tmp_val;
+
+				found_args += 2;
+				break;
+
+			case 'I':
+
+				errno = 0;
+				tmp_val = strtol(optarg, NULL, 10);
+
+				if ( ( tmp_val < 0 ) || ( tmp_val > TQ_MAX_VALUE ) ) {
+
+					printf( "Invalid interface alternation margin specified: %i.\nThe margin has to be between 0 and %i.\n", tmp_val, TQ_MAX_VALUE );
+					exit(EXIT_FAILURE);
+
+				}
+
+				if_alt_margin = tmp_val;
+
+				found_args += 2;
+				break;
+
+			case 'm':
+
+				errno = 0;
+				tmp_val = strtol(optarg, NULL, 10);
+
+				if ( ( tmp_val != METRIC_TQ ) && ( tmp_val != METRIC_THROUGHPUT ) ) {
+
+					printf( "Invalid routing metric specified: %i.\nThe metric has to be %i (transmit quality) or %i (throughput).\n", tmp_val, METRIC_TQ, METRIC_THROUGHPUT );
+					exit(EXIT_FAILURE);
+
+				}
+
+				metric_engine = tmp_val;
+
+				found_args += 2;
+				break;
+
+			case 'P':
+
+				errno = 0;
+				tmp_val = strtol(optarg, NULL, 10);
+
+				/* the limit depends on purge_timeout (see -O) and is checked once all options are known */
+				if ( ( tmp_val < 0 ) || ( tmp_val > UINT16_MAX ) ) {
+
+					printf( "Invalid link probe interval specified: %i ms.\nThe interval has to be between 0 and %i ms.\n", tmp_val, UINT16_MAX );
+					exit(EXIT_FAILURE);
+
+				}
+
+				probe_interval = tmp_val;
+
+				found_args += 2;
+				break;
+
 			case 'h':
 			default:
 				usage();
@@ -673,19 +1014,33 @@ void apply_init_args( int argc, char *argv[] ) {
 	}
 
 
+	if ( ( originator_interval_max > 0 ) && ( originator_interval_max < originator_interval ) ) {
+		fprintf( stderr, "Error - the maximal originator interval can't be smaller than the originator interval !\n" );
+		usage();
+		exit(EXIT_FAILURE);
+	}
+
+	originator_interval_curr = originator_interval;
+
 	if ( ( gateway_class != 0 ) && ( routing_class != 0 ) ) {
 		fprintf( stderr, "Error - routing class can't be set while gateway class is in use !\n" );
 		usage();
 		exit(EXIT_FAILURE);
 	}
 
-	if ( ( gateway_class != 0 ) && ( pref_gateway != 0 ) ) {
+	if ( ( gateway_class != 0 ) && ( pref_gateway != NULL ) ) {
 		fprintf( stderr, "Error - preferred gateway can't be set while gateway class is in use !\n" );
 		usage();
 		exit(EXIT_FAILURE);
 	}
 
-	if ( ( routing_class == 0 ) && ( pref_gateway != 0 ) ) {
+	if ( ( routing_class == 0 ) && ( dhcp_steering ) ) {
+		fprintf( stderr, "Error - DHCP steering can't be used without specifying routing class !\n" );
+		usage();
+		exit(EXIT_FAILURE);
+	}
+
+	if ( ( routing_class == 0 ) && ( pref_gateway != NULL ) ) {
 		fprintf( stderr, "Error - preferred gateway can't be set without specifying routing class !\n" );
 		usage();
 		exit(EXIT_FAILURE);
@@ -696,6 +1051,39 @@ void apply_init_args( int argc, char *argv[] ) {
 
 	if ( ! unix_client ) {
 
+		/* the checks of some parameters depend on other options */
+		for ( i = 0; i < config_num; i++ ) {
+
+			if ( ! config_set( config_args[i], config_msg, sizeof(config_msg), 0 ) ) {
+
+				printf( "%s", config_msg );
+				exit(EXIT_FAILURE);
+
+			}
+
+		}
+
+		if ( originator_interval_max > ORIG_INTERVAL_LIMIT ) {
+
+			printf( "Invalid maximal originator interval specified: %i.\nThe interval has to be between 1 and %i.\n", originator_interval_max, ORIG_INTERVAL_LIMIT );
+			exit(EXIT_FAILURE);
+
+		}
+
+		if ( route_hold_time > ROUTE_HOLD_TIME_MAX ) {
+
+			printf( "Invalid route hold time specified: %i ms.\nThe hold time has to be between 0 and %i ms.\n", route_hold_time, ROUTE_HOLD_TIME_MAX );
+			exit(EXIT_FAILURE);
+
+		}
+
+		if ( probe_interval > PROBE_INTERVAL_MAX ) {
+
+			printf( "Invalid link probe interval specified: %i ms.\nThe interval has to be between 0 and %i ms.\n", probe_interval, PROBE_INTERVAL_MAX );
+			exit(EXIT_FAILURE);
+
+		}
+
 		if ( argc <= found_args ) {
 			fprintf( stderr, "Error - no interface specified\n" );
 			usage();
@@ -769,6 +1157,11 @@ void apply_init_args( int argc, char *argv[] ) {
 			if ( tmp_mtu < tap_mtu )
 				tap_mtu = tmp_mtu;
 
+			batman_if->mtu = tmp_mtu;
+
+			if ( aggregation_enabled )
+				batman_if->aggr_buff = debugMalloc( batman_if->mtu, 207 );
+
 			if ( batman_if->raw_sock > receive_max_sock )
 				receive_max_sock = batman_if->raw_sock;
 
@@ -853,10 +1246,9 @@ void apply_init_args( int argc, char *argv[] ) {
 			if ( routing_class > 0 )
 				printf( "routing class: %i\n", routing_class );
 
-// 			if ( pref_gateway > 0 ) {
-// 				addr_to_string(pref_gateway, str1, sizeof (str1));
-// 				printf( "preferred gateway: %s\n", str1 );
-// 			}
+			if ( pref_gateway != NULL )
+				printf( "preferred gateway: %s\n", addr_to_string_static( pref_gateway ) );
+
 /*
 			if ( vis_server > 0 ) {
 				addr_to_string(vis_server, str1, sizeof (str1));
@@ -868,24 +1260,23 @@ void apply_init_args( int argc, char *argv[] ) {
 	/* connect to running batmand via unix socket */
 	} else {
 
-		if ( ( debug_level > 0 ) && ( debug_level <= debug_level_max ) ) {
+		/* change the given parameters - all of them are printed if there is nothing else to do */
+		for ( i = 0; i < config_num; i++ ) {
 
-			if ( ( debug_level > 2 ) && ( batch_mode ) )
-				printf( "WARNING: Your chosen debug level (%i) does not support batch mode !\n", debug_level );
+			if ( ! unix_config( config_args[i] ) )
+				exit(EXIT_FAILURE);
 
-			unix_if.unix_sock = socket(AF_LOCAL, SOCK_STREAM, 0);
+		}
 
-			memset( &unix_if.addr, 0, sizeof(struct sockaddr_un) );
-			unix_if.addr.sun_family = AF_LOCAL;
-			strcpy( unix_if.addr.sun_path, UNIX_PATH );
+		if ( ( config_num == 0 ) && ( debug_level == 0 ) )
+			unix_config( "" );
 
-			if ( connect ( unix_if.unix_sock, (struct sockaddr *)&unix_if.addr, sizeof(struct sockaddr_un) ) < 0 ) {
+		if ( ( debug_level > 0 ) && ( debug_level <= debug_level_max ) ) {
 
-				printf( "Error - can't connect to unix socket '%s': %s ! Is batmand running on this host ?\n", UNIX_PATH, strerror(errno) );
-				close( unix_if.unix_sock );
-				exit(EXIT_FAILURE);
+			if ( ( debug_level > 2 ) && ( batch_mode ) )
+				printf( "WARNING: Your chosen debug level (%i) does not support batch mode !\n", debug_level );
 
-			}
+			unix_connect();
 
 			unix_buff = debugMalloc( 1501, 5001 );
 			snprintf( unix_buff, 10, "d:%i", debug_level );
@@ -1351,6 +1742,9 @@ void restore_defaults() {
 
 		close( batman_if->raw_sock );
 
+		if ( batman_if->aggr_buff != NULL )
+			debugFree( batman_if->aggr_buff, 1210 );
+
 		list_del( (struct list_head *)&if_list, if_pos, &if_list );
 		debugFree( if_pos, 1206 );
 
@@ -1397,6 +1791,124 @@ int8_t is_multicast_address( uint8_t *dst_addr ) {
 
 
 
+/* hash over the mac addresses and - for IPv4 - over the ip addresses, the protocol and the ports
+ * so that all packets of a flow take the same router in per flow bonding mode (see -B) */
+static uint32_t flow_hash( unsigned char *frame, int16_t frame_len ) {
+
+	struct iphdr *iphdr = (struct iphdr *)( frame + sizeof(struct ether_header) );
+	unsigned char key[25];
+	uint32_t hash = 0;
+	int16_t i, key_len = 2 * ETH_ALEN;
+
+	if ( ( bonding_mode != BONDING_FLOW_HASH ) || ( frame_len < (int16_t)sizeof(struct ether_header) ) )
+		return 0;
+
+	memcpy( key, frame, 2 * ETH_ALEN );
+
+	if ( ( ((struct ether_header *)frame)->ether_type == htons( ETH_P_IP ) ) &&
+	     ( frame_len >= (int16_t)( sizeof(struct ether_header) + sizeof(struct iphdr) ) ) ) {
+
+		memcpy( key + key_len, &iphdr->saddr, 8 );
+		key_len += 8;
+		key[key_len++] = iphdr->protocol;
+
+		/* only the first fragment carries the ports */
+		if ( ( ( iphdr->protocol == IPPROTO_TCP ) || ( iphdr->protocol == IPPROTO_UDP ) ) && ( ( ntohs( iphdr->frag_off ) & 0x3fff ) == 0 ) &&
+		     ( frame_len >= (int16_t)( sizeof(struct ether_header) + iphdr->ihl * 4 + 4 ) ) ) {
+
+			memcpy( key + key_len, frame + sizeof(struct ether_header) + iphdr->ihl * 4, 4 );
+			key_len += 4;
+
+		}
+
+	}
+
+	/* one-at-a-time, like choose_orig() */
+	for ( i = 0; i < key_len; i++ ) {
+		hash += key[i];
+		hash += ( hash << 10 );
+		hash ^= ( hash >> 6 );
+	}
+
+	hash += ( hash << 3 );
+	hash ^= ( hash >> 11 );
+	hash += ( hash << 15 );
+
+	return hash;
+
+}
+
+
+
+/* the DHCP message type (option 53) of the frame in the given direction - 0 if it is no DHCP message */
+static uint8_t dhcp_type( unsigned char *frame, int16_t frame_len, uint16_t dst_port ) {
+
+	struct iphdr *iphdr = (struct iphdr *)( frame + sizeof(struct ether_header) );
+	struct udphdr *udphdr;
+	unsigned char *option;
+	int16_t len;
+
+	if ( ( frame_len < (int16_t)( sizeof(struct ether_header) + sizeof(struct iphdr) ) ) || ( ((struct ether_header *)frame)->ether_type != htons( ETH_P_IP ) ) )
+		return 0;
+
+	if ( ( iphdr->protocol != IPPROTO_UDP ) || ( ( ntohs( iphdr->frag_off ) & 0x3fff ) != 0 ) )
+		return 0;
+
+	len = frame_len - sizeof(struct ether_header) - iphdr->ihl * 4;
+	udphdr = (struct udphdr *)( (unsigned char *)iphdr + iphdr->ihl * 4 );
+
+	if ( ( len < (int16_t)sizeof(struct udphdr) ) || ( udphdr->dest != htons( dst_port ) ) )
+		return 0;
+
+	/* the options follow the fixed BOOTP part (236 bytes) and the magic cookie */
+	option = (unsigned char *)( udphdr + 1 ) + 240;
+	len -= sizeof(struct udphdr) + 240;
+
+	while ( ( len >= 3 ) && ( option[0] != 255 ) ) {
+
+		/* pad */
+		if ( option[0] == 0 ) {
+			option++;
+			len--;
+			continue;
+		}
+
+		if ( option[0] == 53 )
+			return option[2];
+
+		len -= option[1] + 2;
+		option += option[1] + 2;
+
+	}
+
+	return 0;
+
+}
+
+
+
+/* DHCP offers for our clients are only accepted from the selected gateway (see -D) */
+static int dhcp_offer_blocked( unsigned char *frame, int16_t frame_len, unsigned char *orig ) {
+
+	if ( ( !dhcp_steering ) || ( curr_gateway == NULL ) )
+		return 0;
+
+	if ( dhcp_type( frame, frame_len, DHCP_CLIENT_PORT ) != DHCP_OFFER )
+		return 0;
+
+	/* the sender is unknown - better let it pass */
+	if ( ( orig == NULL ) || ( compare_orig( orig, curr_gateway->orig_node->orig ) == 0 ) )
+		return 0;
+
+	debug_output( 4, "DHCP steering: dropping offer of %s \n", addr_to_string_static( orig ) );
+	dhcp_offers_dropped++;
+
+	return 1;
+
+}
+
+
+
 int8_t receive_packet_tap(unsigned char *packet_buff, int16_t packet_buff_len, int16_t *pay_buff_len)
 {
 	struct unicast_packet 	*unicast_packet;
@@ -1406,12 +1918,13 @@ int8_t receive_packet_tap(unsigned char *packet_buff, int16_t packet_buff_len, i
 	struct list_head 		*if_pos;
 	struct batman_if 		*batman_if;
 	struct orig_node 		*orig_node;
+	struct neigh_node 		*router;
 	int 					 i;
 
 	payload_ptr = packet_buff + BATMAN_MAXPACKETSIZE;
 
 	/* save data from kernel into a buffer but spare space for the header information */
-	for (i=0; i< PACKETS_PER_CYCLE; i++) {
+	for (i=0; i< packets_per_cycle; i++) {
 		errno=EWOULDBLOCK;
 		if ( ( *pay_buff_len = read( tap_sock, payload_ptr, packet_buff_len - 1 - BATMAN_MAXPACKETSIZE ) ) > 0 ) {
 
@@ -1421,14 +1934,23 @@ int8_t receive_packet_tap(unsigned char *packet_buff, int16_t packet_buff_len, i
 				debug_output(4, "HNA: Could not look up destination %s :(\n", addr_to_string_static(((struct ether_header *) payload_ptr)->ether_dhost));
 
 
-#ifdef BROADCAST_UNKNOWN_DEST
 			if ( dhost == NULL )
-				dhost = broadcastAddr;
+				dhost = ( bcast_unknown_dest ? broadcastAddr : ((struct ether_header *)payload_ptr)->ether_dhost );
 
-#else
-			if ( dhost == NULL )
-				dhost = ((struct ether_header *)payload_ptr)->ether_dhost;
-#endif
+			/* DHCP discovers and requests go to the selected gateway instead of the whole mesh */
+			if ( ( dhcp_steering ) && ( curr_gateway != NULL ) && ( is_broadcast_address( dhost ) ) ) {
+
+				switch ( dhcp_type( payload_ptr, *pay_buff_len, DHCP_SERVER_PORT ) ) {
+
+					case DHCP_DISCOVER:
+					case DHCP_REQUEST:
+						dhost = curr_gateway->orig_node->orig;
+						dhcp_steered++;
+						break;
+
+				}
+
+			}
 
 			/* ethernet packet should be broadcasted */
 			if (is_broadcast_address(dhost) || is_multicast_address(dhost)) {
@@ -1469,12 +1991,14 @@ int8_t receive_packet_tap(unsigned char *packet_buff, int16_t packet_buff_len, i
 					/* batman packet type: unicast */
 					unicast_packet->packet_type = BAT_UNICAST;
 					/* set unicast ttl */
-					unicast_packet->ttl = TTL;
+					unicast_packet->ttl = ttl;
 					/* copy the destination for faster routing */
 					memcpy( unicast_packet->dest, dhost, 6 );
 
 
-					if ( send_packet( (unsigned char *)unicast_packet, *pay_buff_len + sizeof(struct unicast_packet), orig_node->batman_if->hw_addr, orig_node->router->addr, orig_node->batman_if->raw_sock ) < 0 )
+					router = orig_forw_router( orig_node, NULL, flow_hash( payload_ptr, *pay_buff_len ) );
+
+					if ( send_packet( (unsigned char *)unicast_packet, *pay_buff_len + sizeof(struct unicast_packet), router->link->if_incoming->hw_addr, router->link->addr, router->link->if_incoming->raw_sock ) < 0 )
 						return -1;
 
 				} else {
@@ -1504,15 +2028,15 @@ int8_t receive_packet_batiface( unsigned char *packet_buff, int16_t packet_buff_
 	struct ether_header 	 ether_header;
 	unsigned char 			*dhost = NULL;
 	struct orig_node 		*orig_node;
+	struct neigh_node 		*router;
 	struct list_head 		*if_pos;
 	int 					 i;
 	char str1[ETH_STR_LEN], str2[ETH_STR_LEN];
 	struct icmp_packet		*icmp_packet;
-	struct batman_packet	*batman_packet;
 	struct bcast_packet		*bcast_packet;
 	struct unicast_packet 	*unicast_packet;
 
-	for (i=0; i<PACKETS_PER_CYCLE; i++) {
+	for (i=0; i<packets_per_cycle; i++) {
 		if ((*pay_buff_len = rawsock_read(batman_if->raw_sock, &ether_header, packet_buff, packet_buff_len-1)) > -1) {
 
 			/* drop packet if it has no batman packet type field */
@@ -1532,14 +2056,20 @@ int8_t receive_packet_batiface( unsigned char *packet_buff, int16_t packet_buff_
 				if ( *pay_buff_len < (int)sizeof(struct batman_packet) )
 					continue;
 
-				batman_packet = ((struct batman_packet *)packet_buff);
-
-				batman_packet->seqno = ntohs( batman_packet->seqno ); /* network to host order for our 16bit seqno. */
-
+				/* the seqno is converted to host order per OGM (see batman()) */
 				(*if_incoming) = batman_if;
 				memcpy( neigh, ether_header.ether_shost, ETH_ALEN );
 
 				return 1;
+			/* link probe - measured right away, only the kernel receive time is of interest */
+			case BAT_PROBE:
+
+				if ( *pay_buff_len < (int)sizeof(struct probe_packet) )
+					continue;
+
+				recv_probe( ether_header.ether_shost, batman_if, (struct probe_packet *)packet_buff, *pay_buff_len, rawsock_timestamp( batman_if->raw_sock ) );
+
+				continue;
 			/* unicast packet */
 			case BAT_UNICAST:
 				/* packet with unicast indication but broadcast recipient */
@@ -1566,7 +2096,10 @@ int8_t receive_packet_batiface( unsigned char *packet_buff, int16_t packet_buff_
 				/* packet for me */
 				if ( is_my_mac( dhost ) == 1 ) {
 
-					tap_write( tap_sock, packet_buff + sizeof(struct unicast_packet), *pay_buff_len - sizeof(struct unicast_packet) );
+					/* the originator of a unicast packet is only known by the translation table */
+					if ( !dhcp_offer_blocked( packet_buff + sizeof(struct unicast_packet), *pay_buff_len - sizeof(struct unicast_packet),
+							transtable_search( ((struct ether_header *)(packet_buff + sizeof(struct unicast_packet)))->ether_shost ) ) )
+						tap_write( tap_sock, packet_buff + sizeof(struct unicast_packet), *pay_buff_len - sizeof(struct unicast_packet) );
 
 
 				/* route it */
@@ -1589,13 +2122,15 @@ int8_t receive_packet_batiface( unsigned char *packet_buff, int16_t packet_buff_
 
 					if ( ( orig_node != NULL ) && ( orig_node->batman_if != NULL ) && ( orig_node->router != NULL ) ) {
 
-						memcpy( ether_header.ether_dhost, orig_node->router->addr, ETH_ALEN );
-						memcpy( ether_header.ether_shost, orig_node->batman_if->hw_addr, ETH_ALEN );
+						router = orig_forw_router( orig_node, batman_if, flow_hash( packet_buff + sizeof(struct unicast_packet), *pay_buff_len - sizeof(struct unicast_packet) ) );
+
+						memcpy( ether_header.ether_dhost, router->link->addr, ETH_ALEN );
+						memcpy( ether_header.ether_shost, router->link->if_incoming->hw_addr, ETH_ALEN );
 
 						/* decrement ttl */
 						unicast_packet->ttl--;
 
-						if ( rawsock_write( orig_node->batman_if->raw_sock, &ether_header, packet_buff, *pay_buff_len ) < 0 ) {
+						if ( rawsock_write( router->link->if_incoming->raw_sock, &ether_header, packet_buff, *pay_buff_len ) < 0 ) {
 
 							debug_output( 0, "Error - can't send data through raw socket: %s\n", strerror(errno) );
 							return -1;
@@ -1638,10 +2173,10 @@ int8_t receive_packet_batiface( unsigned char *packet_buff, int16_t packet_buff_
 								memcpy( icmp_packet->dst, icmp_packet->orig, ETH_ALEN );
 								memcpy( icmp_packet->orig, ether_header.ether_dhost, ETH_ALEN );
 								icmp_packet->msg_type = ECHO_REPLY;
-								icmp_packet->ttl = TTL;
+								icmp_packet->ttl = ttl;
 
 								memcpy( ether_header.ether_shost, orig_node->batman_if->hw_addr, ETH_ALEN );
-								memcpy( ether_header.ether_dhost, orig_node->router->addr, ETH_ALEN );
+								memcpy( ether_header.ether_dhost, orig_node->router->link->addr, ETH_ALEN );
 
 								if ( rawsock_write( orig_node->batman_if->raw_sock, &ether_header, packet_buff, *pay_buff_len ) < 0 ) {
 
@@ -1682,10 +2217,10 @@ int8_t receive_packet_batiface( unsigned char *packet_buff, int16_t packet_buff_
 								memcpy( icmp_packet->dst, icmp_packet->orig, ETH_ALEN );
 								memcpy( icmp_packet->orig, ether_header.ether_dhost, ETH_ALEN );
 								icmp_packet->msg_type = TTL_EXCEEDED;
-								icmp_packet->ttl = TTL;
+								icmp_packet->ttl = ttl;
 
 								memcpy( ether_header.ether_shost, orig_node->batman_if->hw_addr, ETH_ALEN );
-								memcpy( ether_header.ether_dhost, orig_node->router->addr, ETH_ALEN );
+								memcpy( ether_header.ether_dhost, orig_node->router->link->addr, ETH_ALEN );
 
 								if ( rawsock_write( orig_node->batman_if->raw_sock, &ether_header, packet_buff, *pay_buff_len ) < 0 ) {
 
@@ -1707,13 +2242,15 @@ int8_t receive_packet_batiface( unsigned char *packet_buff, int16_t packet_buff_
 
 					if ( ( orig_node != NULL ) && ( orig_node->batman_if != NULL ) && ( orig_node->router != NULL ) ) {
 
-						memcpy( ether_header.ether_dhost, orig_node->router->addr, ETH_ALEN );
-						memcpy( ether_header.ether_shost, orig_node->batman_if->hw_addr, ETH_ALEN );
+						router = orig_forw_router( orig_node, batman_if, 0 );
+
+						memcpy( ether_header.ether_dhost, router->link->addr, ETH_ALEN );
+						memcpy( ether_header.ether_shost, router->link->if_incoming->hw_addr, ETH_ALEN );
 
 						/* decrement ttl */
 						icmp_packet->ttl--;
 
-						if ( rawsock_write( orig_node->batman_if->raw_sock, &ether_header, packet_buff, *pay_buff_len ) < 0 ) {
+						if ( rawsock_write( router->link->if_incoming->raw_sock, &ether_header, packet_buff, *pay_buff_len ) < 0 ) {
 
 							debug_output( 0, "Error - can't send data through raw socket: %s\n", strerror(errno) );
 							return -1;
@@ -1727,11 +2264,9 @@ int8_t receive_packet_batiface( unsigned char *packet_buff, int16_t packet_buff_
 
 			/* broadcast */
 			case BAT_BCAST:
-#ifndef BROADCAST_UNKNOWN_DEST
 				/* packet with broadcast indication but not broadcast recipient */
-				if ( memcmp( &ether_header.ether_dhost, broadcastAddr, ETH_ALEN ) != 0 )
+				if ( ( !bcast_unknown_dest ) && ( memcmp( &ether_header.ether_dhost, broadcastAddr, ETH_ALEN ) != 0 ) )
 					continue;
-#endif
 
 				/* packet with broadcast sender address */
 				if ( memcmp( &ether_header.ether_shost, broadcastAddr, ETH_ALEN ) == 0 )
@@ -1759,8 +2294,9 @@ int8_t receive_packet_batiface( unsigned char *packet_buff, int16_t packet_buff_
 					if (bit_get_packet( orig_node->seq_bits, ntohs(bcast_packet->seqno) - orig_node->last_bcast_seqno, 1))
 						orig_node->last_bcast_seqno= ntohs( bcast_packet->seqno );
 
-					/* broadcast for me */
-					tap_write( tap_sock, packet_buff + sizeof(struct bcast_packet), *pay_buff_len - sizeof(struct bcast_packet) );
+					/* broadcast for me - the offers of other gateways are still rebroadcast for the nodes which selected them */
+					if ( !dhcp_offer_blocked( packet_buff + sizeof(struct bcast_packet), *pay_buff_len - sizeof(struct bcast_packet), bcast_packet->orig ) )
+						tap_write( tap_sock, packet_buff + sizeof(struct bcast_packet), *pay_buff_len - sizeof(struct bcast_packet) );
 
 					/* rebroadcast packet */
 					list_for_each(if_pos, &if_list) {
@@ -1865,8 +2401,8 @@ int8_t send_packet( unsigned char *packet_buff, int16_t packet_buff_len, uint8_t
 //	debug_output( 4, "recv addr %s,", addr_to_string( recv_addr ) );
 //	debug_output( 4, "%02x %02x %02x %02x %02x \n", packet_buff[0], packet_buff[1], packet_buff[2], packet_buff[3], packet_buff[4] );
 
-	/* Try sending PACKETS_PER_CYCLE times to send the packet, and drop it otherwise. */
-	for (i=0; i< PACKETS_PER_CYCLE; i++) {
+	/* Try sending packets_per_cycle times to send the packet, and drop it otherwise. */
+	for (i=0; i< packets_per_cycle; i++) {
 		if ( rawsock_write( send_sock, &ether_header, packet_buff, packet_buff_len ) < 0 ) {
 			if (errno == EAGAIN || errno == ESPIPE){
 				debug_output( 4, "send packet failed, but we retry\n" );
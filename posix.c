@@ -243,7 +243,6 @@ int main( int argc, char *argv[] ) {
 
 
 	INIT_LIST_HEAD_FIRST( forw_list );
-	INIT_LIST_HEAD_FIRST( gw_list );
 	INIT_LIST_HEAD_FIRST( if_list );
 
 
@@ -0,0 +1,160 @@
+/* Copyright (C) 2008 B.A.T.M.A.N. contributors:
+ * Marek Lindner
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ *
+ */
+
+
+
+#include <string.h>
+#include "probe.h"
+#include "originator.h"
+#include "os.h"
+
+
+
+/* 2^(i/8) in 1/256 - the throughput is carried logarithmically within the tq field of the OGMs,
+ * one step is about 9 %, 255 equals about 4 Tbit/s */
+static const uint16_t pow2_eighths[8] = { 256, 279, 304, 332, 362, 395, 431, 470 };
+
+
+
+uint32_t probe_decode( uint8_t value ) {
+
+	return (uint32_t)( ( (uint64_t)pow2_eighths[value & 7] << ( value >> 3 ) ) >> 8 );
+
+}
+
+
+
+/* 8 * log2(throughput) rounded down - 0 is reserved for "no path" */
+uint8_t probe_encode( uint32_t throughput ) {
+
+	uint8_t exp = 0, frac = 7;
+
+	if ( throughput < 2 )
+		return ( throughput == 0 ? 0 : 1 );
+
+	while ( ( exp < 31 ) && ( ( throughput >> ( exp + 1 ) ) > 0 ) )
+		exp++;
+
+	while ( ( frac > 0 ) && ( ( ( (uint64_t)pow2_eighths[frac] << exp ) >> 8 ) > throughput ) )
+		frac--;
+
+	return exp * 8 + frac;
+
+}
+
+
+
+/* the link part of the throughput metric - links which have not been measured yet get a default */
+uint8_t probe_link_metric( struct link_node *link_node ) {
+
+	return probe_encode( link_node->throughput > 0 ? link_node->throughput : THROUGHPUT_DEFAULT );
+
+}
+
+
+
+/* send a burst of back to back probes to every bidirectional link - the neighbour
+ * measures our throughput towards it from their spacing (see recv_probe()) */
+void send_probes( void ) {
+
+	static uint8_t burst = 0;
+	struct hash_it_t *hashit = NULL;
+	struct link_node *link_node;
+	struct probe_packet *probe_packet;
+	unsigned char probe_buff[PROBE_SIZE];
+	int16_t probe_len;
+	uint8_t i;
+
+
+	memset( probe_buff, 0, sizeof(probe_buff) );
+
+	probe_packet = (struct probe_packet *)probe_buff;
+	probe_packet->packet_type = BAT_PROBE;
+	probe_packet->version = COMPAT_VERSION;
+	probe_packet->burst = ++burst;
+	probe_packet->count = PROBE_PACKETS;
+
+	while ( NULL != ( hashit = hash_iterate( link_hash, hashit ) ) ) {
+
+		link_node = hashit->bucket->data;
+
+		/* no need to measure links which are not usable anyway */
+		if ( link_node->tq_own == 0 )
+			continue;
+
+		probe_len = ( link_node->if_incoming->mtu < PROBE_SIZE ? link_node->if_incoming->mtu : PROBE_SIZE );
+
+		for ( i = 0; i < PROBE_PACKETS; i++ ) {
+
+			probe_packet->index = i;
+
+			if ( send_packet( probe_buff, probe_len, link_node->if_incoming->hw_addr, link_node->addr, link_node->if_incoming->raw_sock ) < 0 )
+				break;
+
+		}
+
+	}
+
+}
+
+
+
+/* the probes following the first one of a burst were transmitted back to back -
+ * the time they needed to arrive gives the throughput of the link */
+void recv_probe( uint8_t *neigh, struct batman_if *if_incoming, struct probe_packet *probe_packet, int16_t probe_len, uint64_t rcvd_usec ) {
+
+	struct link_node *link_node;
+	uint32_t throughput;
+
+
+	/* probes are only sent to known neighbours, the link exists once we got their OGMs */
+	if ( NULL == ( link_node = find_link_node( neigh, if_incoming ) ) )
+		return;
+
+	if ( ( probe_packet->burst != link_node->probe_burst ) || ( link_node->probe_first == 0 ) ) {
+
+		link_node->probe_burst = probe_packet->burst;
+		link_node->probe_first_index = probe_packet->index;
+		link_node->probe_first = rcvd_usec;
+		return;
+
+	}
+
+	/* wait for the last probe of the burst (or for what is left of it) */
+	if ( probe_packet->index + 1 < probe_packet->count )
+		return;
+
+	if ( ( probe_packet->index > link_node->probe_first_index ) && ( rcvd_usec > link_node->probe_first ) ) {
+
+		/* bits per microsecond * 1000 = kbit/s */
+		throughput = (uint32_t)( ( (uint64_t)( probe_packet->index - link_node->probe_first_index ) * probe_len * 8 * 1000 ) / ( rcvd_usec - link_node->probe_first ) );
+
+		if ( link_node->throughput == 0 )
+			link_node->throughput = throughput;
+		else
+			link_node->throughput += ( (int64_t)throughput - link_node->throughput ) / ( 1 << THROUGHPUT_EWMA_SHIFT );
+
+		debug_output( 4, "Link probe: %s via %s => %u kbit/s, average %u kbit/s \n", addr_to_string_static( neigh ), if_incoming->dev, throughput, link_node->throughput );
+
+	}
+
+	/* the next burst starts over */
+	link_node->probe_first = 0;
+
+}
@@ -0,0 +1,36 @@
+/* Copyright (C) 2008 B.A.T.M.A.N. contributors:
+ * Marek Lindner
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ *
+ */
+
+
+
+#ifndef _BATMAN_PROBE_H
+#define _BATMAN_PROBE_H
+
+#include <stdint.h>
+#include "batman-adv.h"
+
+
+
+void send_probes( void );
+void recv_probe( uint8_t *neigh, struct batman_if *if_incoming, struct probe_packet *probe_packet, int16_t probe_len, uint64_t rcvd_usec );
+uint8_t probe_encode( uint32_t throughput );
+uint32_t probe_decode( uint8_t value );
+uint8_t probe_link_metric( struct link_node *link_node );
+
+#endif
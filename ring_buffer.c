@@ -20,36 +20,73 @@
 
 
 #include "ring_buffer.h"
+#include "batman-adv.h"
 
 
 
-void ring_buffer_set(uint8_t lq_recv[], uint8_t *lq_index, uint8_t value)
+/* samples has to hold global_win_size values unless the EWMA mode is used */
+void ring_buffer_init(struct tq_ring *tq_ring, uint8_t *samples)
 {
-	lq_recv[*lq_index] = value;
-	*lq_index = ( *lq_index + 1 ) % TQ_GLOBAL_WINDOW_SIZE;
+	tq_ring->samples = ( tq_ewma_shift ? NULL : samples );
+	tq_ring->index = 0;
+	tq_ring->nonzero = 0;
+	tq_ring->sum = 0;
 }
 
-uint8_t ring_buffer_avg(uint8_t lq_recv[])
+void ring_buffer_set(struct tq_ring *tq_ring, uint8_t value)
 {
-	uint8_t *ptr;
-	uint16_t count = 0, i = 0, sum = 0;
+	uint16_t avg_new;
+	uint8_t value_old;
 
-	ptr = lq_recv;
+	if ( tq_ring->samples == NULL ) {
 
-	while ( i < TQ_GLOBAL_WINDOW_SIZE ) {
+		avg_new = value << 8;
+
+		/* the first value is taken as it is */
+		if ( ! tq_ring->nonzero ) {
+
+			tq_ring->sum = avg_new;
+			tq_ring->nonzero = 1;
+
+		} else if ( avg_new > tq_ring->sum ) {
+
+			tq_ring->sum += ( avg_new - tq_ring->sum ) >> tq_ewma_shift;
+
+		} else {
+
+			tq_ring->sum -= ( tq_ring->sum - avg_new ) >> tq_ewma_shift;
 
-		if ( *ptr != 0 ) {
-			count++;
-			sum += *ptr;
 		}
 
-		i++;
-		ptr++;
+		return;
 
 	}
 
-	if ( count == 0 )
+	/* replace the oldest value and keep the sum up to date */
+	value_old = tq_ring->samples[tq_ring->index];
+
+	if ( value_old != 0 ) {
+		tq_ring->sum -= value_old;
+		tq_ring->nonzero--;
+	}
+
+	if ( value != 0 ) {
+		tq_ring->sum += value;
+		tq_ring->nonzero++;
+	}
+
+	tq_ring->samples[tq_ring->index] = value;
+	tq_ring->index = ( tq_ring->index + 1 ) % global_win_size;
+}
+
+/* average of the non-zero values within the window */
+uint8_t ring_buffer_avg(struct tq_ring *tq_ring)
+{
+	if ( tq_ring->samples == NULL )
+		return (uint8_t)( ( tq_ring->sum + 128 ) >> 8 );
+
+	if ( tq_ring->nonzero == 0 )
 		return 0;
 
-	return (uint8_t)(sum / count);
+	return (uint8_t)(tq_ring->sum / tq_ring->nonzero);
 }
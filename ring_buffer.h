@@ -19,10 +19,25 @@
 
 
 
+#ifndef _BATMAN_RING_BUFFER_H
+#define _BATMAN_RING_BUFFER_H
+
 #include <stdint.h>
-#include "batman-adv.h"
 
 
 
-void ring_buffer_set( uint8_t lq_recv[], uint8_t *lq_index, uint8_t value );
-uint8_t ring_buffer_avg( uint8_t lq_recv[] );
+struct tq_ring
+{
+	uint8_t *samples;    /* last global_win_size tq values - NULL in EWMA mode */
+	uint8_t index;
+	uint8_t nonzero;     /* number of samples which are not zero (EWMA mode: average initialised) */
+	uint16_t sum;        /* running sum of the samples (EWMA mode: average in 8.8 fixed point) */
+};
+
+
+
+void ring_buffer_init( struct tq_ring *tq_ring, uint8_t *samples );
+void ring_buffer_set( struct tq_ring *tq_ring, uint8_t value );
+uint8_t ring_buffer_avg( struct tq_ring *tq_ring );
+
+#endif
@@ -24,30 +24,44 @@
 #include "os.h"
 #include "batman-adv.h"
 #include "originator.h"
+#include "metric.h"
 
 
 
-void schedule_own_packet( struct batman_if *batman_if ) {
+/* needed for the forward hash - forwarded packets are the same if they carry the same OGM
+ * and are to be sent the same way (the seqno is still in host order while they are queued) */
+int32_t compare_forw( void *data1, void *data2 ) {
 
-	struct forw_node *forw_node_new, *forw_packet_tmp = NULL;
-	struct list_head *list_pos, *prev_list_head;
-	struct hash_it_t *hashit = NULL;
-	struct orig_node *orig_node;
+	struct forw_node *forw_node1 = data1, *forw_node2 = data2;
+	struct batman_packet *batman_packet1 = (struct batman_packet *)forw_node1->pack_buff;
+	struct batman_packet *batman_packet2 = (struct batman_packet *)forw_node2->pack_buff;
 
+	if ( ( batman_packet1->seqno != batman_packet2->seqno ) ||
+	     ( ( batman_packet1->flags & DIRECTLINK ) != ( batman_packet2->flags & DIRECTLINK ) ) ||
+	     ( forw_node1->if_outgoing != forw_node2->if_outgoing ) )
+		return 1;
 
-	forw_node_new = debugMalloc( sizeof(struct forw_node), 501 );
+	return memcmp( batman_packet1->orig, batman_packet2->orig, 6 );
 
-	INIT_LIST_HEAD( &forw_node_new->list );
+}
 
-	forw_node_new->if_outgoing = batman_if;
-	forw_node_new->own = 1;
-	forw_node_new->send_time = get_time() + originator_interval - JITTER + rand_num(2*JITTER);
 
-	forw_node_new->pack_buff_len = sizeof(struct batman_packet)+num_hna*6;
-	forw_node_new->pack_buff = debugMalloc(forw_node_new->pack_buff_len, 502);
-	memcpy(forw_node_new->pack_buff, &batman_if->out, sizeof(struct batman_packet));
-	if (num_hna > 0)
-		memcpy(forw_node_new->pack_buff+sizeof(struct batman_packet), hna_buff, num_hna*6);
+
+int32_t choose_forw( void *data, int32_t size ) {
+
+	struct batman_packet *batman_packet = (struct batman_packet *)((struct forw_node *)data)->pack_buff;
+
+	return ( choose_orig( batman_packet->orig, size ) + batman_packet->seqno ) % size;
+
+}
+
+
+
+/* the forward list is ordered by send_time */
+static void forw_list_add( struct forw_node *forw_node_new ) {
+
+	struct forw_node *forw_packet_tmp = NULL;
+	struct list_head *list_pos, *prev_list_head;
 
 	prev_list_head = (struct list_head *)&forw_list;
 
@@ -69,79 +83,357 @@ void schedule_own_packet( struct batman_if *batman_if ) {
 	if ( ( forw_packet_tmp == NULL ) || ( forw_packet_tmp->send_time <= forw_node_new->send_time ) )
 		list_add_tail( &forw_node_new->list, &forw_list );
 
-	batman_if->out.seqno++;
+}
+
+
+
+/* the packet buffer of a forw_node is only allocated if the packet does not fit into the node */
+static void forw_node_buff( struct forw_node *forw_node, int16_t pack_buff_len ) {
+
+	if ( ( forw_node->pack_buff != NULL ) && ( forw_node->pack_buff_len == pack_buff_len ) )
+		return;
+
+	if ( ( forw_node->pack_buff != NULL ) && ( forw_node->pack_buff != forw_node->buff ) )
+		debugFree( forw_node->pack_buff, 1503 );
+
+	forw_node->pack_buff = ( pack_buff_len > (int16_t)FORW_BUFF_INLINE ? debugMalloc( pack_buff_len, 504 ) : forw_node->buff );
+	forw_node->pack_buff_len = pack_buff_len;
+
+}
+
+
+
+void forw_node_free( struct forw_node *forw_node ) {
+
+	if ( forw_node->pack_buff != forw_node->buff )
+		debugFree( forw_node->pack_buff, 1501 );
+
+	pool_free( &forw_pool, forw_node );
+
+}
+
+
+
+static uint8_t orig_interval_stable = 0;   /* no topology change since our last packet */
+static uint8_t bootstrap_left = 0;          /* rounds of own packets still to be sent at the bootstrap interval */
+static uint32_t bootstrap_last = 0;         /* when the last bootstrap burst started (0 = never) */
+
+
+
+/* send the own packets which are due later than send_time_max after interval plus up to spread ms instead */
+static void own_packets_forward( uint32_t send_time_max, uint32_t interval, uint32_t spread ) {
+
+	struct forw_node *forw_node;
+	struct list_head *forw_pos, *temp, *prev_list_head;
+	struct list_head_first own_list;
+
+
+	INIT_LIST_HEAD_FIRST( own_list );
+	prev_list_head = (struct list_head *)&forw_list;
+
+	list_for_each_safe( forw_pos, temp, &forw_list ) {
+
+		forw_node = list_entry( forw_pos, struct forw_node, list );
+
+		if ( ( forw_node->own ) && ( forw_node->send_time > send_time_max ) ) {
+
+			list_del( prev_list_head, forw_pos, &forw_list );
+			list_add_tail( forw_pos, &own_list );
 
-	while ( NULL != ( hashit = hash_iterate( orig_hash, hashit ) ) ) {
+		} else {
+
+			prev_list_head = forw_pos;
+
+		}
+
+	}
+
+	list_for_each_safe( forw_pos, temp, &own_list ) {
 
-		orig_node = hashit->bucket->data;
+		forw_node = list_entry( forw_pos, struct forw_node, list );
+
+		list_del( (struct list_head *)&own_list, forw_pos, &own_list );
 
-		debug_output( 4, "count own bcast (schedule_own_packet): old = %i, ", orig_node->bcast_own_sum[batman_if->if_num] );
-		bit_get_packet( (TYPE_OF_WORD *)&(orig_node->bcast_own[batman_if->if_num * NUM_WORDS]), 1, 0 );
-		orig_node->bcast_own_sum[batman_if->if_num] = bit_packet_count( (TYPE_OF_WORD *)&(orig_node->bcast_own[batman_if->if_num * NUM_WORDS]) );
-		debug_output( 4, "new = %i \n", orig_node->bcast_own_sum[batman_if->if_num] );
+		forw_node->send_time = get_time() + interval + rand_num(spread);
+		forw_list_add( forw_node );
 
 	}
+
 }
 
 
 
-void schedule_forward_packet(struct orig_node *orig_node, uint8_t *neigh, struct batman_packet *in, uint8_t directlink, int buff_len, struct batman_if *if_outgoing) {
+/* the topology changed - fall back to the minimal originator interval and bring the own packets forward */
+void orig_interval_reset( void ) {
+
+	orig_interval_stable = 0;
+
+	if ( originator_interval_curr == originator_interval )
+		return;
+
+	debug_output( 4, "Topology changed: originator interval %i -> %i ms \n", originator_interval_curr, originator_interval );
+
+	originator_interval_curr = originator_interval;
+
+	own_packets_forward( get_time() + originator_interval + jitter, originator_interval - jitter, 2*jitter );
+
+}
+
+
+
+/* we just started or got a new neighbour - send a few OGMs in quick succession so that the
+ * links and routes are established within seconds instead of a couple of originator intervals */
+void bootstrap_start( void ) {
+
+	uint32_t now = get_time();
+
+	if ( ( bootstrap_left > 0 ) || ( ( bootstrap_last != 0 ) && ( (int32_t)( now - bootstrap_last ) < BOOTSTRAP_HOLDOFF ) ) )
+		return;
+
+	debug_output( 4, "Bootstrap: sending %i OGMs every %i ms \n", BOOTSTRAP_OGMS, BOOTSTRAP_INTERVAL );
+
+	bootstrap_left = BOOTSTRAP_OGMS;
+	bootstrap_last = ( now != 0 ? now : 1 );
+
+	own_packets_forward( now + BOOTSTRAP_INTERVAL + jitter, BOOTSTRAP_INTERVAL, jitter );
+
+}
+
+
+
+void schedule_own_packet( struct batman_if *batman_if ) {
 
 	struct forw_node *forw_node_new;
-	uint8_t tq_avg = 0;
+	int32_t interval_new;
+
+
+	forw_node_new = pool_alloc( &forw_pool );
+
+	INIT_LIST_HEAD( &forw_node_new->list );
+	forw_node_new->pack_buff = NULL;
+
+	forw_node_new->if_outgoing = batman_if;
+	forw_node_new->own = 1;
+	/* nothing changed since our last packet - let the interval grow (once per round, on the first interface) */
+	if ( ( originator_interval_max > 0 ) && ( batman_if->if_num == 0 ) && ( originator_interval_curr < originator_interval_max ) ) {
+
+		/* grown in 32 bit - the last step might not fit into the interval */
+		interval_new = originator_interval_curr;
+
+		if ( orig_interval_stable )
+			interval_new += ( interval_new / ORIG_INTERVAL_GROWTH > 0 ? interval_new / ORIG_INTERVAL_GROWTH : 1 );
+
+		originator_interval_curr = ( interval_new > originator_interval_max ? originator_interval_max : interval_new );
+
+	}
+
+	if ( batman_if->if_num == 0 )
+		orig_interval_stable = 1;
+
+	if ( bootstrap_left > 0 ) {
+
+		forw_node_new->send_time = get_time() + BOOTSTRAP_INTERVAL + rand_num(jitter);
+
+		if ( batman_if->if_num == found_ifs - 1 )
+			bootstrap_left--;
+
+	} else {
+
+		forw_node_new->send_time = get_time() + originator_interval_curr - jitter + rand_num(2*jitter);
+
+	}
+
+	forw_node_buff(forw_node_new, sizeof(struct batman_packet)+num_hna*6);
+	memcpy(forw_node_new->pack_buff, &batman_if->out, sizeof(struct batman_packet));
+	if (num_hna > 0)
+		memcpy(forw_node_new->pack_buff+sizeof(struct batman_packet), hna_buff, num_hna*6);
+
+	forw_list_add( forw_node_new );
+	forw_list_len++;
+
+	/* the own broadcast windows of the originators follow this seqno lazily (see bcast_own_sync()) */
+	batman_if->out.seqno++;
+}
+
+
+
+void schedule_forward_packet(struct orig_node *orig_node, uint8_t *neigh, struct batman_packet *in, uint8_t directlink, int buff_len, struct batman_if *if_outgoing) {
+
+	struct forw_node *forw_node_new, forw_node_key;
+	struct hashtable_t *swaphash;
+	uint8_t tq_avg = 0, flags, coalesced, shift;
 
 	debug_output( 4, "schedule_forward_packet():  \n" );
 
 	if ( in->ttl <= 1 ) {
 
 		debug_output( 4, "ttl exceeded \n" );
+		return;
+
+	}
+
+	/* fisheye: the farther the OGM has travelled the fewer of its seqnos are passed on - with power of two
+	 * strides every node behind us sees a subset of what we saw. the echos of direct neighbours are never
+	 * thinned, their link quality is measured with them. the hop count assumes that all nodes start
+	 * their OGMs with our ttl - it has to be the same mesh-wide (see -O ttl) */
+	if ( ( fisheye_radius > 0 ) && ( !directlink ) ) {
+
+		shift = ( in->ttl < ttl ? ttl - in->ttl + 1 : 1 ) / fisheye_radius;
+
+		if ( shift > FISHEYE_MAX_SHIFT )
+			shift = FISHEYE_MAX_SHIFT;
+
+		if ( in->seqno & ( ( 1 << shift ) - 1 ) ) {
+
+			debug_output( 4, "Drop packet: fisheye - forwarding only every %i. seqno \n", 1 << shift );
+			return;
+
+		}
+
+	}
+
+	/* the packet we would queue has the same key as the received one */
+	flags = in->flags;
+	in->flags = ( directlink ? DIRECTLINK : 0x00 );
+
+	forw_node_key.pack_buff = (unsigned char *)in;
+	forw_node_key.if_outgoing = if_outgoing;
+
+	forw_node_new = hash_find( forw_hash, &forw_node_key );
+
+	in->flags = flags;
+	coalesced = ( forw_node_new != NULL );
+
+	if ( coalesced ) {
+
+		/* this OGM is still queued - send the latest version of it instead of both */
+		debug_output( 4, "coalescing with queued packet \n" );
+		forw_coalesced++;
 
 	} else {
 
-		forw_node_new = debugMalloc( sizeof(struct forw_node), 503 );
+		if ( forw_list_len >= FORW_LIST_MAX ) {
 
-		INIT_LIST_HEAD(&forw_node_new->list);
+			debug_output( 4, "Drop packet: forward list is full \n" );
+			forw_dropped++;
+			return;
+
+		}
 
-		forw_node_new->pack_buff_len = buff_len;
-		forw_node_new->pack_buff = debugMalloc( forw_node_new->pack_buff_len, 504 );
-		memcpy( forw_node_new->pack_buff, in, forw_node_new->pack_buff_len );
+		forw_node_new = pool_alloc( &forw_pool );
 
-		((struct batman_packet *)forw_node_new->pack_buff)->ttl--;
-		memcpy(((struct batman_packet *)forw_node_new->pack_buff)->old_orig, neigh, 6);
+		INIT_LIST_HEAD(&forw_node_new->list);
+		forw_node_new->pack_buff = NULL;
 
-		/* rebroadcast tq of our best ranking neighbor to ensure the rebroadcast of our best tq value */
-		if ((orig_node->router != NULL) && (orig_node->router->tq_avg != 0)) {
+	}
 
-			/* rebroadcast ogm of best ranking neighbor as is */
-			if (compare_orig(orig_node->router->addr, neigh) != 0) {
+	forw_node_buff( forw_node_new, buff_len );
+	memcpy( forw_node_new->pack_buff, in, forw_node_new->pack_buff_len );
 
-				((struct batman_packet *)forw_node_new->pack_buff)->tq = orig_node->router->tq_avg;
-				((struct batman_packet *)forw_node_new->pack_buff)->ttl = orig_node->router->last_ttl - 1;
+	((struct batman_packet *)forw_node_new->pack_buff)->ttl--;
+	memcpy(((struct batman_packet *)forw_node_new->pack_buff)->old_orig, neigh, 6);
 
-			}
+	/* rebroadcast tq of our best ranking neighbor to ensure the rebroadcast of our best tq value */
+	if ((orig_node->router != NULL) && (orig_node->router->tq_avg != 0)) {
 
-			tq_avg = orig_node->router->tq_avg;
+		/* rebroadcast ogm of best ranking neighbor as is */
+		if (compare_orig(orig_node->router->link->addr, neigh) != 0) {
+
+			((struct batman_packet *)forw_node_new->pack_buff)->tq = orig_node->router->tq_avg;
+			((struct batman_packet *)forw_node_new->pack_buff)->ttl = orig_node->router->last_ttl - 1;
 
 		}
 
-		/* apply hop penalty */
-		((struct batman_packet *)forw_node_new->pack_buff)->tq = (((struct batman_packet *)forw_node_new->pack_buff)->tq * (TQ_MAX_VALUE - TQ_HOP_PENALTY)) / (TQ_MAX_VALUE);
-		debug_output(4, "forwarding: tq_orig: %i, tq_avg: %i, tq_forw: %i, ttl_orig: %i, ttl_forw: %i \n", in->tq, tq_avg, ((struct batman_packet *)forw_node_new->pack_buff)->tq, in->ttl - 1, ((struct batman_packet *)forw_node_new->pack_buff)->ttl);
+		tq_avg = orig_node->router->tq_avg;
 
-		forw_node_new->send_time = get_time();
-		forw_node_new->own = 0;
+	}
 
-		forw_node_new->if_outgoing = if_outgoing;
+	/* apply hop penalty */
+	((struct batman_packet *)forw_node_new->pack_buff)->tq = metric->hop_penalty(((struct batman_packet *)forw_node_new->pack_buff)->tq);
+	debug_output(4, "forwarding: tq_orig: %i, tq_avg: %i, tq_forw: %i, ttl_orig: %i, ttl_forw: %i \n", in->tq, tq_avg, ((struct batman_packet *)forw_node_new->pack_buff)->tq, in->ttl - 1, ((struct batman_packet *)forw_node_new->pack_buff)->ttl);
 
-		if ( directlink )
-			((struct batman_packet *)forw_node_new->pack_buff)->flags = DIRECTLINK;
-		else
-			((struct batman_packet *)forw_node_new->pack_buff)->flags = 0x00;
+	if ( directlink )
+		((struct batman_packet *)forw_node_new->pack_buff)->flags = DIRECTLINK;
+	else
+		((struct batman_packet *)forw_node_new->pack_buff)->flags = 0x00;
 
+	/* a coalesced packet keeps its place in the forward list */
+	if ( coalesced )
+		return;
+
+	forw_node_new->own = 0;
+	forw_node_new->if_outgoing = if_outgoing;
+
+	/* give the forwarded packet the chance to be aggregated with the packets scheduled next */
+	if ( aggregation_enabled ) {
+
+		forw_node_new->send_time = get_time() + MAX_AGGREGATION_MS;
+		forw_list_add( forw_node_new );
+
+	} else {
+
+		forw_node_new->send_time = get_time();
 		list_add( &forw_node_new->list, &forw_list );
 
 	}
 
+	forw_list_len++;
+
+	hash_add( forw_hash, forw_node_new );
+
+	if ( forw_hash->elements * 4 > forw_hash->size ) {
+
+		swaphash = hash_resize( forw_hash, forw_hash->size * 2 );
+
+		if ( swaphash == NULL ) {
+
+			debug_output( 0, "Couldn't resize hash table \n" );
+			restore_and_exit(0);
+
+		}
+
+		forw_hash = swaphash;
+
+	}
+
+}
+
+
+
+static void aggr_flush( struct batman_if *batman_if ) {
+
+	if ( batman_if->aggr_len == 0 )
+		return;
+
+	if ( send_packet( batman_if->aggr_buff, batman_if->aggr_len, batman_if->hw_addr, broadcastAddr, batman_if->raw_sock ) < 0 )
+		restore_and_exit(0);
+
+	batman_if->aggr_frames++;
+	batman_if->aggr_len = 0;
+
+}
+
+
+
+/* send the packet right away or append it to the frame aggregated for this interface */
+static void send_ogm( struct batman_if *batman_if, unsigned char *pack_buff, int16_t pack_buff_len ) {
+
+	if ( ( !aggregation_enabled ) || ( pack_buff_len > batman_if->mtu ) ) {
+
+		if ( send_packet( pack_buff, pack_buff_len, batman_if->hw_addr, broadcastAddr, batman_if->raw_sock ) < 0 )
+			restore_and_exit(0);
+
+		return;
+
+	}
+
+	if ( batman_if->aggr_len + pack_buff_len > batman_if->mtu )
+		aggr_flush( batman_if );
+
+	memcpy( batman_if->aggr_buff + batman_if->aggr_len, pack_buff, pack_buff_len );
+	batman_if->aggr_len += pack_buff_len;
+	batman_if->aggr_ogms++;
+
 }
 
 
@@ -150,9 +442,10 @@ void send_outstanding_packets() {
 
 	struct forw_node *forw_node;
 	struct list_head *forw_pos, *if_pos, *temp;
+	struct list_head_first own_list;
 	struct batman_if *batman_if;
 	uint8_t directlink;
-	uint32_t curr_time;
+	uint32_t curr_time, send_time_max;
 
 
 	if ( list_empty( &forw_list ) )
@@ -160,11 +453,25 @@ void send_outstanding_packets() {
 
 	curr_time = get_time();
 
+	if ( ((struct forw_node *)forw_list.next)->send_time > curr_time )
+		return;
+
+	/* as soon as one packet is due the packets due shortly after it are sent along */
+	send_time_max = curr_time + ( aggregation_enabled ? MAX_AGGREGATION_MS : 0 );
+
+	INIT_LIST_HEAD_FIRST( own_list );
+
 	list_for_each_safe( forw_pos, temp, &forw_list ) {
 
 		forw_node = list_entry( forw_pos, struct forw_node, list );
 
-		if ( forw_node->send_time <= curr_time ) {
+		if ( forw_node->send_time <= send_time_max ) {
+
+			/* it can't be coalesced anymore once its seqno is in network order */
+			if ( !forw_node->own )
+				hash_remove( forw_hash, forw_node );
+
+			forw_list_len--;
 
 			directlink = ( ( ((struct batman_packet *)forw_node->pack_buff)->flags & DIRECTLINK ) ? 1 : 0 );
 
@@ -175,8 +482,7 @@ void send_outstanding_packets() {
 
 				if ( ( forw_node->if_outgoing != NULL ) ) {
 
-					if ( send_packet( forw_node->pack_buff, forw_node->pack_buff_len, forw_node->if_outgoing->hw_addr, broadcastAddr, forw_node->if_outgoing->raw_sock ) < 0 )
-						restore_and_exit(0);
+					send_ogm( forw_node->if_outgoing, forw_node->pack_buff, forw_node->pack_buff_len );
 
 				} else {
 
@@ -197,8 +503,7 @@ void send_outstanding_packets() {
 
 						debug_output(4, "Forwarding packet (originator %s, seqno %d, TTL %d) on interface %s \n", addr_to_string_static(((struct batman_packet *)forw_node->pack_buff)->orig), ntohs( ((struct batman_packet *)forw_node->pack_buff)->seqno ), ((struct batman_packet *)forw_node->pack_buff)->ttl, forw_node->if_outgoing->dev);
 
-						if ( send_packet(forw_node->pack_buff, forw_node->pack_buff_len, forw_node->if_outgoing->hw_addr, broadcastAddr, forw_node->if_outgoing->raw_sock ) < 0 )
-							restore_and_exit(0);
+						send_ogm( forw_node->if_outgoing, forw_node->pack_buff, forw_node->pack_buff_len );
 
 					} else {
 
@@ -214,8 +519,7 @@ void send_outstanding_packets() {
 
 							debug_output(4, "Forwarding packet (originator %s, seqno %d, TTL %d) on interface %s \n", addr_to_string_static(((struct batman_packet *)forw_node->pack_buff)->orig), ntohs( ((struct batman_packet *)forw_node->pack_buff)->seqno ), ((struct batman_packet *)forw_node->pack_buff)->ttl, batman_if->dev);
 
-							if ( send_packet( forw_node->pack_buff, forw_node->pack_buff_len, batman_if->hw_addr, broadcastAddr, batman_if->raw_sock ) < 0 )
-								restore_and_exit(0);
+							send_ogm( batman_if, forw_node->pack_buff, forw_node->pack_buff_len );
 
 						}
 
@@ -227,11 +531,16 @@ void send_outstanding_packets() {
 
 			list_del( (struct list_head *)&forw_list, forw_pos, &forw_list );
 
-			if ( forw_node->own )
-				schedule_own_packet( forw_node->if_outgoing );
+			/* the next own packet is scheduled once we are done - it must not be sent along already */
+			if ( forw_node->own ) {
 
-			debugFree( forw_node->pack_buff, 1501 );
-			debugFree( forw_node, 1502 );
+				list_add_tail( forw_pos, &own_list );
+
+			} else {
+
+				forw_node_free( forw_node );
+
+			}
 
 		} else {
 
@@ -241,4 +550,27 @@ void send_outstanding_packets() {
 
 	}
 
+	if ( aggregation_enabled ) {
+
+		list_for_each( if_pos, &if_list ) {
+
+			batman_if = list_entry( if_pos, struct batman_if, list );
+			aggr_flush( batman_if );
+
+		}
+
+	}
+
+	list_for_each_safe( forw_pos, temp, &own_list ) {
+
+		forw_node = list_entry( forw_pos, struct forw_node, list );
+
+		list_del( (struct list_head *)&own_list, forw_pos, &own_list );
+
+		schedule_own_packet( forw_node->if_outgoing );
+
+		forw_node_free( forw_node );
+
+	}
+
 }
@@ -18,6 +18,11 @@
  */
 
 
+int32_t compare_forw( void *data1, void *data2 );
+int32_t choose_forw( void *data, int32_t size );
+void forw_node_free( struct forw_node *forw_node );
+void orig_interval_reset( void );
+void bootstrap_start( void );
 void schedule_own_packet( struct batman_if *batman_if );
 void schedule_forward_packet(struct orig_node *orig_node, uint8_t *neigh, struct batman_packet *in, uint8_t directlink, int buff_len, struct batman_if *if_outgoing);
 void send_outstanding_packets();
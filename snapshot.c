@@ -0,0 +1,596 @@
+/* Copyright (C) 2008 B.A.T.M.A.N. contributors:
+ * Marek Lindner
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ *
+ */
+
+
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "snapshot.h"
+#include "originator.h"
+#include "trans_table.h"
+#include "os.h"
+
+
+
+#define SNAPSHOT_MAGIC 0x42415453   /* "BATS" */
+#define SNAPSHOT_VERSION 2
+
+
+
+/* the snapshot is only read by the same binary - the records are saved as they are, one after another:
+ * the interfaces, our own clients, the links with their windows and the originators with their
+ * windows, neighbours (including the tq samples) and hna entries */
+struct snapshot_header {
+	uint32_t magic;
+	uint8_t version;
+	uint8_t clean;             /* saved at shutdown - no OGM was sent afterwards */
+	uint8_t word_size;         /* the windows are only taken over if their layout did not change */
+	uint8_t global_win_size;
+	uint16_t local_win_size;
+	uint8_t tq_ewma_shift;
+	uint8_t metric_engine;
+	uint32_t saved;            /* wall clock time in s */
+	uint32_t ogm_gap_min;      /* shortest possible time between two own OGMs in ms - apart from the bootstrap bursts */
+	uint32_t len;
+	uint32_t checksum;         /* of everything behind the header - the periodic snapshots are not synced to disk */
+	uint16_t if_num;
+	uint16_t hna_num;
+	uint32_t link_num;
+	uint32_t orig_num;
+};
+
+struct snapshot_if {
+	uint8_t hw_addr[6];
+	uint16_t seqno;
+	uint16_t bcast_seqno;
+};
+
+struct snapshot_link {
+	uint8_t addr[6];
+	uint8_t if_addr[6];
+	uint16_t real_packet_count;
+	uint16_t real_seqno;
+	uint16_t real_seen;
+	uint16_t bcast_own_sum;
+	uint16_t bcast_own_seqno;
+	uint16_t bcast_own_seen;
+	uint8_t tq_own;
+	uint8_t tq_asym_penalty;
+	uint32_t throughput;
+};
+
+struct snapshot_orig {
+	uint8_t orig[6];
+	uint8_t gwflags;
+	uint8_t last_ttl;
+	uint16_t last_seqno;
+	uint16_t last_real_seqno;
+	uint16_t last_bcast_seqno;
+	uint16_t neigh_num;
+	int16_t hna_buff_len;
+};
+
+struct snapshot_neigh {
+	uint8_t addr[6];
+	uint8_t if_addr[6];
+	uint8_t tq_avg;
+	uint8_t last_ttl;
+	uint8_t ring_index;
+	uint8_t ring_nonzero;
+	uint16_t ring_sum;
+};
+
+struct snapshot_cursor {
+	unsigned char *buff;       /* NULL while the size of the snapshot is determined */
+	uint32_t pos;
+	uint32_t len;
+};
+
+
+
+static void snap_put( struct snapshot_cursor *cursor, void *data, uint32_t len ) {
+
+	if ( cursor->buff != NULL )
+		memcpy( cursor->buff + cursor->pos, data, len );
+
+	cursor->pos += len;
+
+}
+
+static int snap_get( struct snapshot_cursor *cursor, void *data, uint32_t len ) {
+
+	if ( cursor->pos + len > cursor->len )
+		return -1;
+
+	memcpy( data, cursor->buff + cursor->pos, len );
+	cursor->pos += len;
+
+	return 0;
+
+}
+
+static uint32_t snapshot_checksum( unsigned char *buff, uint32_t len ) {
+
+	uint32_t sum = 0;
+
+	while ( len-- > 0 ) {
+
+		sum += *buff++;
+		sum += ( sum << 10 );
+		sum ^= ( sum >> 6 );
+
+	}
+
+	return sum;
+
+}
+
+static struct batman_if *snapshot_if_find( uint8_t *hw_addr ) {
+
+	struct list_head *if_pos;
+	struct batman_if *batman_if;
+
+	list_for_each( if_pos, &if_list ) {
+
+		batman_if = list_entry( if_pos, struct batman_if, list );
+
+		if ( memcmp( batman_if->hw_addr, hw_addr, 6 ) == 0 )
+			return batman_if;
+
+	}
+
+	return NULL;
+
+}
+
+
+
+/* serialize the state - without a buffer only the size is counted */
+static void snapshot_write( struct snapshot_cursor *cursor, uint8_t clean ) {
+
+	struct snapshot_header header;
+	struct snapshot_if snap_if;
+	struct snapshot_link snap_link;
+	struct snapshot_orig snap_orig;
+	struct snapshot_neigh snap_neigh;
+	struct list_head *if_pos;
+	struct batman_if *batman_if, *primary_if = (struct batman_if *)if_list.next;
+	struct hash_it_t *hashit = NULL;
+	struct link_node *link_node;
+	struct orig_node *orig_node;
+	struct neigh_node *neigh_node;
+	struct trans_element_t *elem;
+	uint32_t i;
+
+
+	memset( &header, 0, sizeof(header) );
+	header.magic = SNAPSHOT_MAGIC;
+	header.version = SNAPSHOT_VERSION;
+	header.clean = clean;
+	header.word_size = sizeof(TYPE_OF_WORD);
+	header.global_win_size = global_win_size;
+	header.local_win_size = local_win_size;
+	header.tq_ewma_shift = tq_ewma_shift;
+	header.metric_engine = metric_engine;
+	header.saved = time( NULL );
+	header.ogm_gap_min = ( originator_interval > jitter ? originator_interval - jitter : 1 );
+	header.len = cursor->len;
+	header.if_num = found_ifs;
+	header.link_num = link_hash->elements;
+	header.orig_num = orig_num;
+
+	dlist_for_each_entry( elem, &hna_list, list_link ) {
+
+		if ( memcmp( elem->mac, primary_if->hw_addr, 6 ) != 0 )
+			header.hna_num++;
+
+	}
+
+	/* the header is completed once everything else is written */
+	snap_put( cursor, &header, sizeof(header) );
+
+	list_for_each( if_pos, &if_list ) {
+
+		batman_if = list_entry( if_pos, struct batman_if, list );
+
+		memcpy( snap_if.hw_addr, batman_if->hw_addr, 6 );
+		snap_if.seqno = batman_if->out.seqno;
+		snap_if.bcast_seqno = batman_if->bcast_seqno;
+
+		snap_put( cursor, &snap_if, sizeof(snap_if) );
+
+	}
+
+	dlist_for_each_entry( elem, &hna_list, list_link ) {
+
+		if ( memcmp( elem->mac, primary_if->hw_addr, 6 ) != 0 )
+			snap_put( cursor, elem->mac, 6 );
+
+	}
+
+	while ( NULL != ( hashit = hash_iterate( link_hash, hashit ) ) ) {
+
+		link_node = hashit->bucket->data;
+
+		memcpy( snap_link.addr, link_node->addr, 6 );
+		memcpy( snap_link.if_addr, link_node->if_incoming->hw_addr, 6 );
+		snap_link.real_packet_count = link_node->real_packet_count;
+		snap_link.real_seqno = link_node->real_seqno;
+		snap_link.real_seen = link_node->real_seen;
+		snap_link.bcast_own_sum = link_node->bcast_own_sum;
+		snap_link.bcast_own_seqno = link_node->bcast_own_seqno;
+		snap_link.bcast_own_seen = link_node->bcast_own_seen;
+		snap_link.tq_own = link_node->tq_own;
+		snap_link.tq_asym_penalty = link_node->tq_asym_penalty;
+		snap_link.throughput = link_node->throughput;
+
+		snap_put( cursor, &snap_link, sizeof(snap_link) );
+		snap_put( cursor, link_node->real_bits, 2 * local_win_words * sizeof(TYPE_OF_WORD) );
+
+	}
+
+	for ( i = 0; i < orig_num; i++ ) {
+
+		orig_node = orig_index[i];
+
+		memcpy( snap_orig.orig, orig_node->orig, 6 );
+		snap_orig.gwflags = orig_node->gwflags;
+		snap_orig.last_ttl = orig_node->last_ttl;
+		snap_orig.last_seqno = orig_node->last_seqno;
+		snap_orig.last_real_seqno = orig_node->last_real_seqno;
+		snap_orig.last_bcast_seqno = orig_node->last_bcast_seqno;
+		snap_orig.neigh_num = 0;
+		snap_orig.hna_buff_len = ( orig_node->hna_buff != NULL ? orig_node->hna_buff_len : 0 );
+
+		dlist_for_each_entry( neigh_node, &orig_node->neigh_list, list )
+			snap_orig.neigh_num++;
+
+		snap_put( cursor, &snap_orig, sizeof(snap_orig) );
+		snap_put( cursor, orig_node->seq_bits, 2 * local_win_words * sizeof(TYPE_OF_WORD) );
+
+		dlist_for_each_entry( neigh_node, &orig_node->neigh_list, list ) {
+
+			memcpy( snap_neigh.addr, neigh_node->link->addr, 6 );
+			memcpy( snap_neigh.if_addr, neigh_node->link->if_incoming->hw_addr, 6 );
+			snap_neigh.tq_avg = neigh_node->tq_avg;
+			snap_neigh.last_ttl = neigh_node->last_ttl;
+			snap_neigh.ring_index = neigh_node->tq_ring.index;
+			snap_neigh.ring_nonzero = neigh_node->tq_ring.nonzero;
+			snap_neigh.ring_sum = neigh_node->tq_ring.sum;
+
+			snap_put( cursor, &snap_neigh, sizeof(snap_neigh) );
+
+			if ( neigh_node->tq_ring.samples != NULL )
+				snap_put( cursor, neigh_node->tq_ring.samples, global_win_size );
+
+		}
+
+		if ( snap_orig.hna_buff_len > 0 )
+			snap_put( cursor, orig_node->hna_buff, snap_orig.hna_buff_len );
+
+	}
+
+	if ( cursor->buff != NULL ) {
+
+		header.checksum = snapshot_checksum( cursor->buff + sizeof(header), cursor->pos - sizeof(header) );
+		memcpy( cursor->buff, &header, sizeof(header) );
+
+	}
+
+}
+
+
+
+/* write the routing state to a new file which replaces the old one at once - a crash while
+ * saving leaves the previous snapshot intact */
+void snapshot_save( uint8_t clean ) {
+
+	struct snapshot_cursor cursor = { NULL, 0, 0 };
+	char tmp_file[256];
+	int32_t fd;
+
+
+	snapshot_write( &cursor, clean );
+	cursor.len = cursor.pos;
+	cursor.pos = 0;
+
+	snprintf( tmp_file, sizeof(tmp_file), "%s.tmp", snapshot_file );
+
+	if ( ( fd = open( tmp_file, O_RDWR | O_CREAT | O_TRUNC, 0600 ) ) < 0 ) {
+
+		debug_output( 0, "Error - can't create snapshot file %s: %s\n", tmp_file, strerror(errno) );
+		return;
+
+	}
+
+	if ( ftruncate( fd, cursor.len ) < 0 ) {
+
+		debug_output( 0, "Error - can't resize snapshot file %s: %s\n", tmp_file, strerror(errno) );
+		close( fd );
+		return;
+
+	}
+
+	cursor.buff = mmap( NULL, cursor.len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+	close( fd );
+
+	if ( cursor.buff == MAP_FAILED ) {
+
+		debug_output( 0, "Error - can't map snapshot file %s: %s\n", tmp_file, strerror(errno) );
+		return;
+
+	}
+
+	snapshot_write( &cursor, clean );
+
+	/* the periodic snapshots are left to the kernel - only the last one has to be on disk before we are gone */
+	msync( cursor.buff, cursor.len, ( clean ? MS_SYNC : MS_ASYNC ) );
+	munmap( cursor.buff, cursor.len );
+
+	if ( rename( tmp_file, snapshot_file ) < 0 ) {
+
+		debug_output( 0, "Error - can't replace snapshot file %s: %s\n", snapshot_file, strerror(errno) );
+		return;
+
+	}
+
+	debug_output( 4, "Saved routing state to %s (%u bytes) \n", snapshot_file, cursor.len );
+
+}
+
+
+
+static int snapshot_restore_links( struct snapshot_cursor *cursor, uint32_t link_num ) {
+
+	struct snapshot_link snap_link;
+	struct link_node *link_node;
+	struct batman_if *batman_if;
+	uint32_t win_len = 2 * local_win_words * sizeof(TYPE_OF_WORD);
+
+
+	while ( link_num-- > 0 ) {
+
+		if ( snap_get( cursor, &snap_link, sizeof(snap_link) ) < 0 )
+			return -1;
+
+		/* the interface is gone */
+		if ( ( batman_if = snapshot_if_find( snap_link.if_addr ) ) == NULL ) {
+
+			cursor->pos += win_len;
+			continue;
+
+		}
+
+		link_node = get_link_node( snap_link.addr, batman_if );
+
+		if ( snap_get( cursor, link_node->real_bits, win_len ) < 0 )
+			return -1;
+
+		link_node->real_packet_count = snap_link.real_packet_count;
+		link_node->real_seqno = snap_link.real_seqno;
+		link_node->real_seen = snap_link.real_seen;
+		link_node->bcast_own_sum = snap_link.bcast_own_sum;
+		link_node->bcast_own_seqno = snap_link.bcast_own_seqno;
+		link_node->bcast_own_seen = snap_link.bcast_own_seen;
+		link_node->tq_own = snap_link.tq_own;
+		link_node->tq_asym_penalty = snap_link.tq_asym_penalty;
+		link_node->throughput = snap_link.throughput;
+
+		link_node_refresh( link_node, curr_time );
+
+	}
+
+	return 0;
+
+}
+
+static int snapshot_restore_origs( struct snapshot_cursor *cursor, uint32_t snap_orig_num ) {
+
+	struct snapshot_orig snap_orig;
+	struct snapshot_neigh snap_neigh;
+	struct orig_node *orig_node;
+	struct neigh_node *neigh_node;
+	struct link_node *link_node;
+	struct batman_if *batman_if;
+	uint32_t win_len = 2 * local_win_words * sizeof(TYPE_OF_WORD);
+	uint32_t samples_len = ( tq_ewma_shift ? 0 : global_win_size );
+
+
+	while ( snap_orig_num-- > 0 ) {
+
+		if ( snap_get( cursor, &snap_orig, sizeof(snap_orig) ) < 0 )
+			return -1;
+
+		if ( cursor->pos + win_len > cursor->len )
+			return -1;
+
+		orig_node = get_orig_node( snap_orig.orig );
+
+		snap_get( cursor, orig_node->seq_bits, win_len );
+		orig_node->last_ttl = snap_orig.last_ttl;
+		orig_node->last_seqno = snap_orig.last_seqno;
+		orig_node->last_real_seqno = snap_orig.last_real_seqno;
+		orig_node->last_bcast_seqno = snap_orig.last_bcast_seqno;
+		orig_node_refresh( orig_node, curr_time );
+
+		while ( snap_orig.neigh_num-- > 0 ) {
+
+			if ( snap_get( cursor, &snap_neigh, sizeof(snap_neigh) ) < 0 )
+				return -1;
+
+			if ( ( ( batman_if = snapshot_if_find( snap_neigh.if_addr ) ) == NULL ) ||
+			     ( ( link_node = find_link_node( snap_neigh.addr, batman_if ) ) == NULL ) ) {
+
+				cursor->pos += samples_len;
+				continue;
+
+			}
+
+			neigh_node = create_neighbor( orig_node, link_node );
+			neigh_node_refresh( neigh_node, curr_time );
+
+			neigh_node->tq_avg = snap_neigh.tq_avg;
+			neigh_node->last_ttl = snap_neigh.last_ttl;
+			neigh_node->tq_ring.index = snap_neigh.ring_index;
+			neigh_node->tq_ring.nonzero = snap_neigh.ring_nonzero;
+			neigh_node->tq_ring.sum = snap_neigh.ring_sum;
+
+			if ( ( samples_len > 0 ) && ( snap_get( cursor, neigh_node->tq_ring.samples, samples_len ) < 0 ) )
+				return -1;
+
+		}
+
+		if ( ( snap_orig.hna_buff_len < 0 ) || ( cursor->pos + snap_orig.hna_buff_len > cursor->len ) )
+			return -1;
+
+		orig_restore_routes( orig_node, ( snap_orig.hna_buff_len > 0 ? cursor->buff + cursor->pos : NULL ), snap_orig.hna_buff_len, snap_orig.gwflags );
+		cursor->pos += snap_orig.hna_buff_len;
+
+	}
+
+	return 0;
+
+}
+
+/* pick up the state the last run left behind - our sequence numbers continue where they stopped (the neighbours
+ * would drop our OGMs as duplicates for a while otherwise), the routes are usable before the first OGM comes in */
+void snapshot_load( void ) {
+
+	struct snapshot_cursor cursor = { NULL, 0, 0 };
+	struct snapshot_header header;
+	struct snapshot_if snap_if;
+	struct batman_if *batman_if;
+	struct stat st;
+	uint8_t hna_mac[6];
+	uint32_t seqno_skip = 0, bcast_seqno_skip = 0;
+	int32_t fd, age;
+	uint16_t i;
+
+
+	if ( ( fd = open( snapshot_file, O_RDONLY ) ) < 0 ) {
+
+		if ( errno != ENOENT )
+			debug_output( 0, "Error - can't open snapshot file %s: %s\n", snapshot_file, strerror(errno) );
+
+		return;
+
+	}
+
+	if ( ( fstat( fd, &st ) < 0 ) || ( st.st_size < (off_t)sizeof(header) ) ) {
+
+		debug_output( 0, "Warning - ignoring invalid snapshot file %s \n", snapshot_file );
+		close( fd );
+		return;
+
+	}
+
+	cursor.len = st.st_size;
+	cursor.buff = mmap( NULL, cursor.len, PROT_READ, MAP_PRIVATE, fd, 0 );
+	close( fd );
+
+	if ( cursor.buff == MAP_FAILED ) {
+
+		debug_output( 0, "Error - can't map snapshot file %s: %s\n", snapshot_file, strerror(errno) );
+		return;
+
+	}
+
+	snap_get( &cursor, &header, sizeof(header) );
+	age = time( NULL ) - header.saved;
+
+	if ( ( header.magic != SNAPSHOT_MAGIC ) || ( header.version != SNAPSHOT_VERSION ) || ( header.len != cursor.len ) ||
+	     ( header.checksum != snapshot_checksum( cursor.buff + sizeof(header), cursor.len - sizeof(header) ) ) ) {
+
+		debug_output( 0, "Warning - ignoring invalid snapshot file %s \n", snapshot_file );
+		goto unmap;
+
+	}
+
+	/* everybody else forgot about us by now - a clock which went backwards makes the age unknown */
+	if ( ( age < 0 ) || ( age > SNAPSHOT_MAX_AGE ) ) {
+
+		debug_output( 3, "Ignoring snapshot file %s: saved %i s ago \n", snapshot_file, age );
+		goto unmap;
+
+	}
+
+	curr_time = get_time();
+
+	/* we might have sent OGMs and broadcasts after a periodic snapshot - skip at least as many seqnos as could have
+	 * been used meanwhile (including a bootstrap burst per BOOTSTRAP_HOLDOFF, see bootstrap_start()),
+	 * the broadcasts are skipped beyond the duplicate window of the receivers */
+	if ( ! header.clean ) {
+
+		seqno_skip = ( age + 1 ) * 1000 / header.ogm_gap_min + 1 + BOOTSTRAP_OGMS * ( ( age + 1 ) * 1000 / BOOTSTRAP_HOLDOFF + 1 );
+		bcast_seqno_skip = local_win_size + 1;
+
+	}
+
+	for ( i = 0; i < header.if_num; i++ ) {
+
+		if ( snap_get( &cursor, &snap_if, sizeof(snap_if) ) < 0 )
+			goto truncated;
+
+		if ( ( batman_if = snapshot_if_find( snap_if.hw_addr ) ) == NULL )
+			continue;
+
+		batman_if->out.seqno = snap_if.seqno + seqno_skip;
+		batman_if->bcast_seqno = snap_if.bcast_seqno + bcast_seqno_skip;
+
+	}
+
+	for ( i = 0; i < header.hna_num; i++ ) {
+
+		if ( snap_get( &cursor, hna_mac, 6 ) < 0 )
+			goto truncated;
+
+		hna_add( hna_mac, ((struct batman_if *)if_list.next)->hw_addr );
+
+	}
+
+	/* the windows and tq samples are saved as they are */
+	if ( ( header.word_size != sizeof(TYPE_OF_WORD) ) || ( header.local_win_size != local_win_size ) ||
+	     ( header.global_win_size != global_win_size ) || ( header.tq_ewma_shift != tq_ewma_shift ) ||
+	     ( header.metric_engine != metric_engine ) ) {
+
+		debug_output( 3, "Snapshot file %s: the window sizes or the metric changed - only the sequence numbers are taken over \n", snapshot_file );
+		goto unmap;
+
+	}
+
+	if ( ( snapshot_restore_links( &cursor, header.link_num ) < 0 ) || ( snapshot_restore_origs( &cursor, header.orig_num ) < 0 ) )
+		goto truncated;
+
+	debug_output( 3, "Restored %u originators and %u links from snapshot file %s (saved %i s ago) \n", orig_num, link_hash->elements, snapshot_file, age );
+	goto unmap;
+
+truncated:
+	debug_output( 0, "Warning - snapshot file %s is truncated \n", snapshot_file );
+
+unmap:
+	munmap( cursor.buff, cursor.len );
+
+}
@@ -162,7 +162,7 @@ void hna_update()
 /*	debug_output(4, "HNA: hna_update() (curr_time = %d)", curr_time);*/
 	dlist_for_each_entry_safe(elem, tmp, &hna_list, list_link) {
 		/* purge old entries, but never ourselves */
-		if (((curr_time - elem->age) > AGE_THRESHOLD) && (memcmp(elem->mac, ((struct batman_if *)if_list.next)->hw_addr, 6)!= 0)) {
+		if (((curr_time - elem->age) > age_threshold) && (memcmp(elem->mac, ((struct batman_if *)if_list.next)->hw_addr, 6)!= 0)) {
 			debug_output(3, "HNA: hna_update: purge old mac %s.\n", addr_to_string_static(elem->mac) );
 			hna_del(elem);
 			hna_changed = 1;
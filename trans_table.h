@@ -29,6 +29,8 @@ struct trans_element_t {
 
 };
 
+extern struct dlist_head hna_list;	/* our own clients */
+
 int 			 transtable_init();
 int 			 transtable_quit();
 int 			 transtable_add( unsigned char *mac, unsigned char *batman_mac);